@@ -15,315 +15,5274 @@
 *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
+#define PCRE2_CODE_UNIT_WIDTH 0
+#include <pcre2.h>
 #include <vte/vte.h>
 #include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define PROCESS_SAMPLE_INTERVAL 2
+#define PROCESS_BENCHMARK_ROUNDS 50
+#define PTY_READ_SIZE (64 * 1024)
+#define FEED_INPUT_LIMIT (4 * 1024 * 1024)
+#define FEED_BARRIER_TIMEOUT 50
+#define HUD_REFRESH_INTERVAL 500
+#define HUD_DRAW_SAMPLES 128
+#define HUD_BYTES_PER_CELL 16
+#define LATENCY_PENDING 32
+#define LATENCY_BUCKETS 24
+#define LATENCY_TIMEOUT G_USEC_PER_SEC
+#define ZOOM_STEP 1.2
+#define ZOOM_MIN 0.25
+#define ZOOM_MAX 4.0
+#define REWRAP_DEFER_ROWS 5000
+#define REWRAP_SETTLE_DELAY 300
+#define PTY_SIZE_SETTLE_DELAY 150
+#define SETTINGS_RELOAD_DELAY 100
+#define PALETTE_SIZE 16
+#define SHORTCUT_COUNT 19
+#define OSC_BUFFER_SIZE 64
+#define TRIGGER_INPUT_LIMIT (1024 * 1024)
+#define TRIGGER_LINE_LIMIT 4096
+#define TRIGGER_LITERAL_MIN 3
+#define TRIGGER_SLICE 2000
+#define TRIGGER_BUDGET 20000
+#define TRIGGER_NOTIFY_INTERVAL G_USEC_PER_SEC
+#define HEARTBEAT_INTERVAL 1
+#define BROADCAST_QUEUE_LIMIT (64 * 1024)
+#define ACCESSIBILITY_QUERY_TIMEOUT 250
+#define THUMBNAIL_WIDTH 240
+#define THUMBNAIL_MAX_HEIGHT 240
+#define THUMBNAIL_REFRESH_INTERVAL 250
+#define THUMBNAIL_SLICE 4000
+#define THUMBNAIL_MEMORY_LIMIT (8 * 1024 * 1024)
+#define SCROLLBACK_CHUNK_ROWS 1000
+#define LINK_CHARS "-./?%&_=+@~:#"
+#define METRICS_INTERVAL 5
+#define METRIC_BUCKETS 10
+#define ARCHIVE_BLOCK_ROWS 2000
+#define ARCHIVE_MARGIN_ROWS 4000
+#define ARCHIVE_SEGMENT_LIMIT (256 * 1024 * 1024)
+#define ARCHIVE_BENCHMARK_SCROLLBACK 10000
+#define ARCHIVE_BENCHMARK_SEEKS 200
+#define SEARCH_RESULT_LIMIT 1000
+#define SEARCH_SLICE_TIME 4000
+#define IMAGE_BYTES_PER_PIXEL 4
+#define IMAGE_PIXELS_PER_BYTE 6
+#define IMAGE_PARAMS_LIMIT 32
+#define SOAK_INTERVAL 50
+#define SOAK_SAMPLE_INTERVAL 5
+#define SOAK_WARMUP 30
+#define SOAK_MINIMUM (SOAK_WARMUP + 2 * SOAK_SAMPLE_INTERVAL)
+#define SOAK_SETTLE 2
+#define SOAK_RSS_GROWTH (8 * 1024 * 1024)
+#define SOAK_FD_GROWTH 4
+#define SOAK_OBJECT_GROWTH 64
+#define SOAK_CHILD "sleep 0.2"
+#define APPLICATION_ID "slck.illumiterm"
+#define WINDOW_PROCESSES_MAX 16
+#define PROBE_INTERVAL 50
+#define PROBE_DELAY 500
+#define PROBE_QUIET "stty -icanon; exec cat > /dev/null"
+#define PROBE_FLOOD "yes 'IllumiTerm latency benchmark flood 0123456789 abcdefghijklmnopqrstuvwxyz' & sleep %d; kill $!"
+#define PALETTE_RGB(hex) {((hex) >> 16 & 0xff) / 255.0, ((hex) >> 8 & 0xff) / 255.0, ((hex) & 0xff) / 255.0, 1.0}
+
+enum {
+    LINK_URL,
+    LINK_FILE,
+    LINK_COUNT
+};
+
+enum {
+    IMAGE_SCAN_TEXT,
+    IMAGE_SCAN_ESCAPE,
+    IMAGE_SCAN_PARAMS,
+    IMAGE_SCAN_RASTER,
+    IMAGE_SCAN_BODY,
+    IMAGE_SCAN_BODY_ESCAPE
+};
+
+typedef struct {
+    gint64 key;
+    gint64 write;
+    gint64 echo;
+    guchar byte;
+} KeySample;
+
+typedef struct {
+    const gchar* name;
+    const gchar* help;
+    gint64 bounds[METRIC_BUCKETS];
+    atomic_uint_fast64_t buckets[METRIC_BUCKETS + 1];
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sum;
+} MetricHistogram;
+
+typedef struct {
+    glong first_row;
+    guint64 first_line;
+    guint lines;
+    guint64 offset;
+    gsize length;
+    gsize raw_length;
+    guint segment;
+} ArchiveBlock;
+
+typedef struct {
+    gchar* path;
+    gint fd;
+    guint64 size;
+} ArchiveSegment;
+
+typedef struct {
+    gchar* stem;
+    GArray* segments;
+    gint keep;
+    GMutex lock;
+    GArray* blocks;
+    guint64 lines;
+    guint64 size;
+    guint64 raw_size;
+    gint64 write_time;
+    glong limit;
+    glong next_row;
+    glong pending_row;
+    GString* pending;
+} ScrollbackArchive;
+
+typedef struct {
+    ScrollbackArchive* archive;
+    GString* text;
+    glong first_row;
+    GFile* destination;
+} ArchiveJob;
+
+typedef struct {
+    guint64 line;
+    gchar* text;
+} ArchiveMatch;
+
+typedef struct {
+    ScrollbackArchive* archive;
+    GRegex* regex;
+    glong live_row;
+} ArchiveSearch;
+
+typedef struct {
+    guint64 rss;
+    guint fds;
+    guint objects;
+} SoakSample;
+
+typedef struct {
+    guint64 buckets[LATENCY_BUCKETS + 1];
+    guint64 count;
+    guint64 dropped;
+    gint64 to_write;
+    gint64 to_echo;
+    gint64 to_frame;
+    gint64 max;
+} LatencyHistogram;
+
+typedef struct {
+    glong row;
+    glong command_row;
+    glong command_column;
+    glong output_row;
+    glong end_row;
+    glong end_column;
+    gint64 started;
+    gint64 finished;
+    gint exit_status;
+    gchar* command;
+} PromptMark;
+
+typedef struct {
+    GtkWidget* terminal;
+    GtkWidget* window;
+    GtkWidget* tab_label;
+    GPid pid;
+    GPid foreground;
+    gint stat_fd;
+    gint io_fd;
+    guint64 cpu_ticks;
+    guint64 io_bytes;
+    gint64 sampled_at;
+    gdouble cpu;
+    guint64 rss;
+    gdouble io_rate;
+    gchar command[64];
+    gchar* badge;
+    VtePty* pty;
+    gboolean closed;
+    guint read_source;
+    gboolean read_paused;
+    guint write_source;
+    GByteArray* input;
+    GByteArray* held;
+    guint feed_source;
+    gboolean fed_unprocessed;
+    gboolean exit_pending;
+    gint exit_status;
+    GByteArray* output;
+    guint64 bytes_in;
+    guint64 bytes_out;
+    glong pty_rows;
+    glong pty_columns;
+    glong pending_rows;
+    glong pending_columns;
+    guint size_tick;
+    guint size_settle_source;
+    GtkWidget* page;
+    GtkWidget* overlay;
+    GtkWidget* hud;
+    gulong hud_draw_handler;
+    gulong hud_drawn_handler;
+    gint64 draw_started;
+    gint64 draw_times[HUD_DRAW_SAMPLES];
+    guint draw_count;
+    guint64 frames;
+    guint64 hud_bytes_mark;
+    guint64 hud_frames_mark;
+    gint64 hud_sampled_at;
+    KeySample latency[LATENCY_PENDING];
+    guint latency_first;
+    guint latency_count;
+    gulong latency_key_handler;
+    gulong latency_draw_handler;
+    gboolean rewrap_deferred;
+    guint rewrap_source;
+    GArray* prompts;
+    guint osc_match;
+    guint osc_length;
+    gchar osc[OSC_BUFFER_SIZE];
+    gboolean mark_pending;
+    gchar mark[OSC_BUFFER_SIZE];
+    GByteArray* trigger_input;
+    GArray* trigger_tags;
+    guint64 trigger_hits;
+    guint64 trigger_skipped;
+    gint64 trigger_window;
+    gint64 trigger_used;
+    gint64 trigger_notified;
+    gboolean trigger_marked;
+    gint activity;
+    gint64 last_output;
+    gint64 seen_output;
+    gint64 quiet_output;
+    guint64 sampled_bytes;
+    gchar* cwd;
+    gchar* name;
+    gboolean broadcast_group;
+    GByteArray* broadcast_input;
+    guint64 broadcast_dropped;
+    GtkWidget* broadcast_badge;
+    cairo_surface_t* thumbnail;
+    gboolean thumbnail_dirty;
+    gint64 thumbnail_at;
+    GtkWidget* overview_item;
+    gint link_tags[LINK_COUNT];
+    gint64 spawned_at;
+    ScrollbackArchive* archive;
+    gboolean images;
+    guint image_scan;
+    guint image_field;
+    guint image_raster[4];
+    gsize image_body;
+    gboolean image_dropped;
+    GByteArray* image_held;
+    guint images_unplaced;
+    guint64 images_dropped;
+    gpointer image_current;
+    guint64 held_total;
+    guint64 fed_total;
+} TerminalState;
+
+typedef struct {
+    TerminalState* state;
+    glong row;
+    gsize bytes;
+    guint64 end;
+} InlineImage;
+
+typedef struct {
+    const gchar* id;
+    const gchar* counterpart;
+    GdkRGBA foreground;
+    GdkRGBA background;
+    GdkRGBA colors[PALETTE_SIZE];
+} Palette;
+
+enum {
+    ACCESSIBILITY_AUTO,
+    ACCESSIBILITY_ENABLED,
+    ACCESSIBILITY_DISABLED
+};
+
+enum {
+    BROADCAST_OFF,
+    BROADCAST_WINDOW,
+    BROADCAST_ALL,
+    BROADCAST_GROUP
+};
+
+enum {
+    TAB_NORMAL,
+    TAB_ACTIVITY,
+    TAB_SILENT
+};
+
+enum {
+    TRIGGER_HIGHLIGHT = 1 << 0,
+    TRIGGER_NOTIFY = 1 << 1,
+    TRIGGER_MARK = 1 << 2
+};
+
+typedef struct {
+    gchar* name;
+    gchar* pattern;
+    gchar* literal;
+    gchar* prefilter;
+    guint actions;
+    gint group;
+    VteRegex* highlight;
+} Trigger;
+
+typedef struct {
+    gchar* font;
+    GdkRGBA foreground;
+    GdkRGBA background;
+    gchar* palette;
+    GdkRGBA custom_palette[PALETTE_SIZE];
+    gint cursor_blink_time;
+    gint cursor_blink_timeout;
+    gboolean allow_bold;
+    gboolean bold_is_bright;
+    gboolean cursor_blink;
+    VteCursorShape cursor_shape;
+    gboolean audible_bell;
+    GtkPositionType tab_position;
+    glong columns;
+    glong rows;
+    glong scrollback;
+    gboolean hide_scrollbar;
+    gboolean hide_menu_bar;
+    gboolean hide_mouse_pointer;
+    gchar* word_chars;
+    gchar* pipe_command;
+    gboolean disable_menu_key;
+    gboolean disable_confirm;
+    glong silence_seconds;
+    gboolean notify_tabs;
+    gboolean export_metrics;
+    gboolean archive_scrollback;
+    gboolean keep_archive;
+    gboolean inline_images;
+    glong image_memory;
+    glong window_processes;
+    gint accessibility;
+    gchar* shortcuts[SHORTCUT_COUNT];
+    GHashTable* keybindings;
+    GPtrArray* triggers;
+    GRegex* trigger_regex;
+    GRegex* trigger_literals;
+} Settings;
+
+typedef struct {
+    GtkWidget* terminal;
+    GIOStream* connection;
+    GOutputStream* stream;
+    gchar* target;
+    gchar* chunk;
+    glong row;
+    glong end_row;
+    guint64 written;
+} ScrollbackExport;
+
+enum {
+    PROCESS_COLUMN_TAB,
+    PROCESS_COLUMN_PID,
+    PROCESS_COLUMN_COMMAND,
+    PROCESS_COLUMN_CPU,
+    PROCESS_COLUMN_RSS,
+    PROCESS_COLUMN_IO,
+    PROCESS_NUM_COLUMNS
+};
+
+enum {
+    COMMAND_COLUMN_COMMAND,
+    COMMAND_COLUMN_STATUS,
+    COMMAND_COLUMN_DURATION,
+    COMMAND_COLUMN_ROW,
+    COMMAND_NUM_COLUMNS
+};
+
+enum {
+    SEARCH_COLUMN_WHERE,
+    SEARCH_COLUMN_TEXT,
+    SEARCH_COLUMN_ROW,
+    SEARCH_NUM_COLUMNS
+};
+
+GList* Terminals = NULL;
+GtkWidget* ActiveTerminal = NULL;
+guint HeartbeatSource = 0;
+guint HeartbeatTicks = 0;
+guint64 Wakeups = 0;
+guint64 HudWakeupsMark = 0;
+gint64 HudWakeupsSampled = 0;
+gdouble HudWakeupRate = 0;
+gint BroadcastMode = BROADCAST_OFF;
+GtkWidget* BroadcastWindow = NULL;
+guint BroadcastSource = 0;
+GtkWidget* TypingTerminal = NULL;
+guint TypingSource = 0;
+gint64 ProcessSampleDuration = 0;
+GtkWidget* ProcessPanel = NULL;
+GtkWidget* ProcessPanelStatus = NULL;
+GtkListStore* ProcessStore = NULL;
+GtkWidget* CommandPanel = NULL;
+GtkListStore* CommandStore = NULL;
+TerminalState* CommandPanelTerminal = NULL;
+GtkWidget* SearchPanel = NULL;
+GtkListStore* SearchStore = NULL;
+TerminalState* SearchTerminal = NULL;
+GCancellable* SearchCancellable = NULL;
+GRegex* SearchRegex = NULL;
+guint SearchSource = 0;
+glong SearchRow = 0;
+glong SearchLastRow = 0;
+glong SearchLiveRow = 0;
+guint SearchFound = 0;
+GThreadPool* ArchivePool = NULL;
+gint ArchiveJobsPending = 0;
+guint ArchiveCount = 0;
+gboolean BenchmarkArchive = FALSE;
+GQueue Images = G_QUEUE_INIT;
+gsize ImageBytes = 0;
+GtkWidget* SoakTerminal = NULL;
+guint SoakSteps = 0;
+gint64 SoakStarted = 0;
+gint64 SoakWarmup = 0;
+gint64 SoakUntil = 0;
+gint64 SoakSampled = 0;
+gboolean SoakBaselined = FALSE;
+SoakSample SoakBaseline;
+SoakSample SoakPeak;
+gint ShardIndex = 0;
+guint ShardNext = 0;
+GtkWidget* ProbeTerminal = NULL;
+GThread* ProbeThread = NULL;
+gint ProbeFd = -1;
+gint ProbeProcesses = 1;
+gint ProbeRunning = 0;
+atomic_int_fast64_t ProbeSent;
+gboolean ProbeEchoed = FALSE;
+GArray* ProbeSamples = NULL;
+guint HudCount = 0;
+guint HudSource = 0;
+gboolean LatencyTracing = FALSE;
+gint64 LayoutStarted = 0;
+gint64 ResizeStallLast = 0;
+gint64 ResizeStallMax = 0;
+guint64 ResizeCount = 0;
+guint64 SentWinches = 0;
+guint64 SuppressedWinches = 0;
+LatencyHistogram Latency;
+Settings* CurrentSettings = NULL;
+GFileMonitor* SettingsMonitor = NULL;
+gboolean SettingsUnreadable = FALSE;
+guint SettingsReloadSource = 0;
+guint TriggerSource = 0;
+gint64 ProcessStarted = 0;
+gint64 MenuBuildTime = 0;
+gboolean AccessibilityBypassed = FALSE;
+const gchar* AccessibilityDecision = "kept";
+gint64 AccessibilityQueryTime = 0;
+guint64 FeedBatches = 0;
+gint BenchmarkPending = 0;
+gint BenchmarkPanes = 0;
+gint BenchmarkWindows = 0;
+gint64 BenchmarkStarted = 0;
+guint64 BenchmarkFrames = 0;
+guint ThumbnailSource = 0;
+gsize ThumbnailBytes = 0;
+guint ThumbnailCount = 0;
+GtkWidget* Overview = NULL;
+guint OverviewSource = 0;
+VteRegex* LinkRegexes[LINK_COUNT];
+GThread* MetricsThread = NULL;
+GMutex MetricsLock;
+GCond MetricsCond;
+gboolean MetricsRunning = FALSE;
+gchar* MetricsPath = NULL;
+gchar* MetricsLabels = NULL;
+gint64 PollReturned = 0;
+atomic_uint_fast64_t MetricBytesIn;
+atomic_uint_fast64_t MetricBytesOut;
+atomic_uint_fast64_t MetricFrames;
+atomic_uint_fast64_t MetricWindows;
+atomic_uint_fast64_t MetricTabs;
+atomic_uint_fast64_t MetricTerminals;
+atomic_uint_fast64_t MetricScrollbackRows;
+atomic_uint_fast64_t MetricScrollbackBytes;
+MetricHistogram DispatchHistogram = {"illumiterm_main_loop_dispatch_seconds", "Time the main loop spent dispatching between two polls.",
+                                     {1000, 2000, 5000, 10000, 16000, 33000, 50000, 100000, 250000, 1000000}};
+MetricHistogram SpawnHistogram = {"illumiterm_spawn_latency_seconds", "Time from requesting a terminal to its child process running.",
+                                  {1000, 2000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000}};
+
+const gchar* TabPositionNames[] = {"top", "bottom", "left", "right"};
+const GtkPositionType TabPositions[] = {GTK_POS_TOP, GTK_POS_BOTTOM, GTK_POS_LEFT, GTK_POS_RIGHT};
+const gchar* TriggerActionNames[] = {"highlight", "notify", "mark"};
+const gchar* AccessibilityNames[] = {"auto", "enabled", "disabled"};
+const gchar* ShortcutNames[SHORTCUT_COUNT] = {
+    "NewWindow", "NewTab", "CloseTab", "CloseWindow", "Copy", "Paste", "ZoomIn", "ZoomOut", "ZoomReset",
+    "NameTab", "PreviousTab", "NextTab", "MoveTabLeft", "MoveTabRight",
+    "MoveWindowLeft", "MoveWindowRight", "EnterFullscreen", "ResetWindowPosition", "TabOverview"
+};
+const gchar* ShortcutLabels[SHORTCUT_COUNT] = {
+    "New Window", "New Tab", "Close Tab", "Close Window", "Copy", "Paste", "Zoom In", "Zoom Out", "Zoom Reset",
+    "Name Tab", "Previous Tab", "Next Tab", "Move Tab Left", "Move Tab Right",
+    "Move Window Left", "Move Window Right", "Enter Fullscreen", "Reset Window Position", "Tab Overview"
+};
+const gchar* DefaultShortcuts[SHORTCUT_COUNT] = {
+    "Shift+Ctrl+N", "Shift+Ctrl+T", "Shift+Ctrl+W", "Shift+Ctrl+Q", "Shift+Ctrl+C", "Shift+Ctrl+V",
+    "Shift+Ctrl++", "Shift+Ctrl+_", "Shift+Ctrl+)", "Shift+Ctrl+I", "Shift+Ctrl+Left", "Shift+Ctrl+Right",
+    "Shift+Ctrl+Page Up", "Shift+Ctrl+Page Down", "Super+Left", "Super+Right", "Super+Page Up", "Super+Page Down",
+    "Shift+Ctrl+O"
+};
+gint64 PaletteSwitchStarted = 0;
+gint64 PaletteSwitchApply = 0;
+gint64 PaletteSwitchFrame = 0;
+guint PaletteSwitchTerminals = 0;
+guint PalettePendingDraws = 0;
+
+const Palette Palettes[] = {
+    {"vga", NULL, PALETTE_RGB(0xaaaaaa), PALETTE_RGB(0x000000), {
+        PALETTE_RGB(0x000000), PALETTE_RGB(0xaa0000), PALETTE_RGB(0x00aa00), PALETTE_RGB(0xaa5500),
+        PALETTE_RGB(0x0000aa), PALETTE_RGB(0xaa00aa), PALETTE_RGB(0x00aaaa), PALETTE_RGB(0xaaaaaa),
+        PALETTE_RGB(0x555555), PALETTE_RGB(0xff5555), PALETTE_RGB(0x55ff55), PALETTE_RGB(0xffff55),
+        PALETTE_RGB(0x5555ff), PALETTE_RGB(0xff55ff), PALETTE_RGB(0x55ffff), PALETTE_RGB(0xffffff)}},
+    {"xterm", NULL, PALETTE_RGB(0xe5e5e5), PALETTE_RGB(0x000000), {
+        PALETTE_RGB(0x000000), PALETTE_RGB(0xcd0000), PALETTE_RGB(0x00cd00), PALETTE_RGB(0xcdcd00),
+        PALETTE_RGB(0x0000ee), PALETTE_RGB(0xcd00cd), PALETTE_RGB(0x00cdcd), PALETTE_RGB(0xe5e5e5),
+        PALETTE_RGB(0x7f7f7f), PALETTE_RGB(0xff0000), PALETTE_RGB(0x00ff00), PALETTE_RGB(0xffff00),
+        PALETTE_RGB(0x5c5cff), PALETTE_RGB(0xff00ff), PALETTE_RGB(0x00ffff), PALETTE_RGB(0xffffff)}},
+    {"tango", NULL, PALETTE_RGB(0xd3d7cf), PALETTE_RGB(0x2e3436), {
+        PALETTE_RGB(0x2e3436), PALETTE_RGB(0xcc0000), PALETTE_RGB(0x4e9a06), PALETTE_RGB(0xc4a000),
+        PALETTE_RGB(0x3465a4), PALETTE_RGB(0x75507b), PALETTE_RGB(0x06989a), PALETTE_RGB(0xd3d7cf),
+        PALETTE_RGB(0x555753), PALETTE_RGB(0xef2929), PALETTE_RGB(0x8ae234), PALETTE_RGB(0xfce94f),
+        PALETTE_RGB(0x729fcf), PALETTE_RGB(0xad7fa8), PALETTE_RGB(0x34e2e2), PALETTE_RGB(0xeeeeec)}},
+    {"solarized-dark", "solarized-light", PALETTE_RGB(0x839496), PALETTE_RGB(0x002b36), {
+        PALETTE_RGB(0x073642), PALETTE_RGB(0xdc322f), PALETTE_RGB(0x859900), PALETTE_RGB(0xb58900),
+        PALETTE_RGB(0x268bd2), PALETTE_RGB(0xd33682), PALETTE_RGB(0x2aa198), PALETTE_RGB(0xeee8d5),
+        PALETTE_RGB(0x002b36), PALETTE_RGB(0xcb4b16), PALETTE_RGB(0x586e75), PALETTE_RGB(0x657b83),
+        PALETTE_RGB(0x839496), PALETTE_RGB(0x6c71c4), PALETTE_RGB(0x93a1a1), PALETTE_RGB(0xfdf6e3)}},
+    {"solarized-light", "solarized-dark", PALETTE_RGB(0x657b83), PALETTE_RGB(0xfdf6e3), {
+        PALETTE_RGB(0x073642), PALETTE_RGB(0xdc322f), PALETTE_RGB(0x859900), PALETTE_RGB(0xb58900),
+        PALETTE_RGB(0x268bd2), PALETTE_RGB(0xd33682), PALETTE_RGB(0x2aa198), PALETTE_RGB(0xeee8d5),
+        PALETTE_RGB(0x002b36), PALETTE_RGB(0xcb4b16), PALETTE_RGB(0x586e75), PALETTE_RGB(0x657b83),
+        PALETTE_RGB(0x839496), PALETTE_RGB(0x6c71c4), PALETTE_RGB(0x93a1a1), PALETTE_RGB(0xfdf6e3)}}
+};
+
+const gint64 LatencyBucketLimits[LATENCY_BUCKETS] = {
+    100, 141, 200, 283, 400, 566, 800, 1131, 1600, 2263, 3200, 4525,
+    6400, 9051, 12800, 18102, 25600, 36204, 51200, 72408, 102400, 144815, 204800, 289631
+};
+
+TerminalState* GetTerminalState(GtkWidget* terminal) {
+    return g_object_get_data(G_OBJECT(terminal), "state");
+}
+
+TerminalState* GetActiveTerminalState(void) {
+    if (ActiveTerminal != NULL) {
+        return GetTerminalState(ActiveTerminal);
+    }
+    return Terminals != NULL ? Terminals->data : NULL;
+}
+
+GtkWidget* GetWindowNotebook(GtkWidget* window) {
+    return g_object_get_data(G_OBJECT(window), "notebook");
+}
+
+gboolean IsCurrentTab(TerminalState* state) {
+    GtkNotebook* notebook = GTK_NOTEBOOK(GetWindowNotebook(state->window));
+    return gtk_notebook_get_nth_page(notebook, gtk_notebook_get_current_page(notebook)) == state->page;
+}
+
+gboolean IsFocusedPane(TerminalState* state) {
+    return g_object_get_data(G_OBJECT(state->page), "terminal") == state->terminal;
+}
+
+gchar* GetDisplayDirectory(const gchar* directory) {
+    const gchar* home = g_get_home_dir();
+    gsize length = strlen(home);
+    if (strncmp(directory, home, length) == 0 && (directory[length] == '/' || directory[length] == '\0')) {
+        return g_strdup_printf("~%s", directory + length);
+    }
+    return g_strdup(directory);
+}
+
+void UpdateTabLabel(TerminalState* state) {
+    if (!IsFocusedPane(state)) {
+        return;
+    }
+    const gchar* title = state->name != NULL ? state->name : vte_terminal_get_window_title(VTE_TERMINAL(state->terminal));
+    gchar* directory = NULL;
+    if ((title == NULL || title[0] == '\0') && state->cwd != NULL) {
+        title = directory = GetDisplayDirectory(state->cwd);
+    }
+    if (title == NULL || title[0] == '\0') {
+        title = "Tab";
+    }
+    if (state->activity == TAB_SILENT) {
+        gchar* text = g_strdup_printf("%s (silent %lds)", title, CurrentSettings->silence_seconds);
+        gtk_label_set_text(GTK_LABEL(state->tab_label), text);
+        g_free(text);
+    } else {
+        gtk_label_set_text(GTK_LABEL(state->tab_label), title);
+    }
+    g_free(directory);
+}
+
+void DirectoryChanged(VteTerminal* terminal, gpointer data) {
+    TerminalState* state = GetTerminalState(GTK_WIDGET(terminal));
+    if (state == NULL) {
+        return;
+    }
+    const gchar* uri = vte_terminal_get_current_directory_uri(terminal);
+    gchar* host = NULL;
+    gchar* path = uri != NULL ? g_filename_from_uri(uri, &host, NULL) : NULL;
+    if (host == NULL || host[0] == '\0' || g_strcmp0(host, "localhost") == 0 || g_strcmp0(host, g_get_host_name()) == 0) {
+        g_free(state->cwd);
+        state->cwd = path;
+        UpdateTabLabel(state);
+    } else {
+        g_free(path);
+    }
+    g_free(host);
+}
+
+void SetTabActivity(TerminalState* state, gint activity) {
+    if (state->activity == activity) {
+        return;
+    }
+    GtkStyleContext* context = gtk_widget_get_style_context(state->tab_label);
+    gtk_style_context_remove_class(context, state->activity == TAB_ACTIVITY ? "activity" : "silent");
+    if (activity != TAB_NORMAL) {
+        gtk_style_context_add_class(context, activity == TAB_ACTIVITY ? "activity" : "silent");
+    }
+    state->activity = activity;
+    UpdateTabLabel(state);
+
+    if (activity != TAB_NORMAL && CurrentSettings->notify_tabs) {
+        const gchar* title = gtk_label_get_text(GTK_LABEL(state->tab_label));
+        gchar* id = g_strdup_printf("tab-%p", (gpointer) state);
+        GNotification* notification = g_notification_new(activity == TAB_ACTIVITY ? "New output" : "Tab is silent");
+        g_notification_set_body(notification, title);
+        g_application_send_notification(g_application_get_default(), id, notification);
+        g_object_unref(notification);
+        g_free(id);
+    }
+}
+
+void UpdateCursorBlink(TerminalState* state, const Settings* settings) {
+    gboolean blink = settings->cursor_blink && gtk_window_is_active(GTK_WINDOW(state->window)) && IsCurrentTab(state);
+    vte_terminal_set_cursor_blink_mode(VTE_TERMINAL(state->terminal), blink ? VTE_CURSOR_BLINK_ON : VTE_CURSOR_BLINK_OFF);
+}
+
+void UpdateWindowCursorBlink(GtkWidget* window) {
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        if (state->window == window) {
+            UpdateCursorBlink(state, CurrentSettings);
+        }
+    }
+}
+
+gboolean CheckActivity(gint64 now) {
+    gint64 silence = CurrentSettings->silence_seconds * G_USEC_PER_SEC;
+    gboolean pending = FALSE;
+
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        if (IsCurrentTab(state)) {
+            state->seen_output = state->last_output;
+        } else if (silence > 0 && state->last_output != state->quiet_output && now - state->last_output >= silence) {
+            state->quiet_output = state->last_output;
+            SetTabActivity(state, TAB_SILENT);
+        } else if (state->last_output > state->seen_output && state->activity != TAB_SILENT) {
+            SetTabActivity(state, TAB_ACTIVITY);
+        } else if (state->activity == TAB_SILENT && state->last_output != state->quiet_output) {
+            SetTabActivity(state, TAB_ACTIVITY);
+        }
+        pending = pending || state->last_output != state->seen_output || (silence > 0 && state->last_output != state->quiet_output);
+    }
+    return pending;
+}
+
+void CloseProcessFiles(TerminalState* state) {
+    if (state->stat_fd >= 0) {
+        close(state->stat_fd);
+    }
+    if (state->io_fd >= 0) {
+        close(state->io_fd);
+    }
+    state->stat_fd = -1;
+    state->io_fd = -1;
+    state->foreground = 0;
+}
+
+void OpenProcessFiles(TerminalState* state, GPid pid) {
+    gchar path[64];
+
+    CloseProcessFiles(state);
+
+    g_snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    state->stat_fd = open(path, O_RDONLY | O_CLOEXEC);
+    g_snprintf(path, sizeof(path), "/proc/%d/io", pid);
+    state->io_fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    state->foreground = pid;
+    state->sampled_at = 0;
+    state->cpu = 0;
+    state->io_rate = 0;
+}
+
+gboolean ReadProcessFile(gint fd, gchar* buffer, gsize size) {
+    if (fd < 0) {
+        return FALSE;
+    }
+    gssize length = pread(fd, buffer, size - 1, 0);
+    if (length <= 0) {
+        return FALSE;
+    }
+    buffer[length] = '\0';
+    return TRUE;
+}
+
+GPid GetForegroundProcess(TerminalState* state) {
+    if (state->pty != NULL) {
+        GPid group = tcgetpgrp(vte_pty_get_fd(state->pty));
+        if (group > 0) {
+            return group;
+        }
+    }
+    return state->pid;
+}
+
+void SampleProcess(TerminalState* state, gint64 now) {
+    static glong clock_ticks = 0;
+    static glong page_size = 0;
+    gchar buffer[1024];
+
+    if (state->pid <= 0) {
+        return;
+    }
+    if (clock_ticks == 0) {
+        clock_ticks = sysconf(_SC_CLK_TCK);
+        page_size = sysconf(_SC_PAGESIZE);
+    }
+
+    GPid foreground = GetForegroundProcess(state);
+    if (foreground != state->foreground) {
+        OpenProcessFiles(state, foreground);
+        if (state->stat_fd < 0 && foreground != state->pid) {
+            OpenProcessFiles(state, state->pid);
+        }
+    }
+
+    if (!ReadProcessFile(state->stat_fd, buffer, sizeof(buffer))) {
+        CloseProcessFiles(state);
+        return;
+    }
+
+    gchar* open_paren = strchr(buffer, '(');
+    gchar* close_paren = strrchr(buffer, ')');
+    if (open_paren == NULL || close_paren == NULL || close_paren < open_paren) {
+        return;
+    }
+    gsize length = MIN((gsize)(close_paren - open_paren - 1), sizeof(state->command) - 1);
+    memcpy(state->command, open_paren + 1, length);
+    state->command[length] = '\0';
+
+    unsigned long utime = 0, stime = 0;
+    long rss = 0;
+    sscanf(close_paren + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d %*d %*d %*d %*d %*u %*u %ld", &utime, &stime, &rss);
+
+    guint64 io_bytes = 0;
+    if (ReadProcessFile(state->io_fd, buffer, sizeof(buffer))) {
+        guint64 rchar = 0, wchar = 0;
+        sscanf(buffer, "rchar: %" G_GUINT64_FORMAT " wchar: %" G_GUINT64_FORMAT, &rchar, &wchar);
+        io_bytes = rchar + wchar;
+    }
+
+    guint64 ticks = utime + stime;
+    if (state->sampled_at > 0 && now > state->sampled_at && ticks >= state->cpu_ticks && io_bytes >= state->io_bytes) {
+        gdouble elapsed = (now - state->sampled_at) / (gdouble) G_USEC_PER_SEC;
+        state->cpu = (ticks - state->cpu_ticks) * 100.0 / clock_ticks / elapsed;
+        state->io_rate = (io_bytes - state->io_bytes) / elapsed;
+    }
+    state->cpu_ticks = ticks;
+    state->io_bytes = io_bytes;
+    state->rss = (guint64) MAX(rss, 0) * page_size;
+    state->sampled_at = now;
+}
+
+void UpdateProcessBadge(TerminalState* state) {
+    if (state->tab_label == NULL || state->foreground == 0) {
+        return;
+    }
+    gchar* rss = g_format_size(state->rss);
+    gchar* io = g_format_size((guint64) state->io_rate);
+    gchar* badge = g_strdup_printf("%s (%d): %.1f%% CPU, %s RSS, %s/s I/O", state->command, state->foreground, state->cpu, rss, io);
+
+    if (g_strcmp0(badge, state->badge) != 0) {
+        gtk_widget_set_tooltip_text(state->tab_label, badge);
+        g_free(state->badge);
+        state->badge = badge;
+    } else {
+        g_free(badge);
+    }
+    g_free(rss);
+    g_free(io);
+}
+
+void RefreshProcessPanel(void) {
+    if (ProcessPanel == NULL) {
+        return;
+    }
+    gtk_list_store_clear(ProcessStore);
+
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        const gchar* tab = state->tab_label != NULL ? gtk_label_get_text(GTK_LABEL(state->tab_label)) : NULL;
+        gchar* cpu = g_strdup_printf("%.1f%%", state->cpu);
+        gchar* rss = g_format_size(state->rss);
+        gchar* io_rate = g_format_size((guint64) state->io_rate);
+        gchar* io = g_strdup_printf("%s/s", io_rate);
+        GtkTreeIter iter;
+
+        gtk_list_store_append(ProcessStore, &iter);
+        gtk_list_store_set(ProcessStore, &iter,
+            PROCESS_COLUMN_TAB, tab != NULL ? tab : "Tab",
+            PROCESS_COLUMN_PID, state->foreground,
+            PROCESS_COLUMN_COMMAND, state->command,
+            PROCESS_COLUMN_CPU, cpu,
+            PROCESS_COLUMN_RSS, rss,
+            PROCESS_COLUMN_IO, io,
+            -1);
+
+        g_free(cpu);
+        g_free(rss);
+        g_free(io_rate);
+        g_free(io);
+    }
+
+    gchar* status = g_strdup_printf("%u terminals sampled in %" G_GINT64_FORMAT " \302\265s", g_list_length(Terminals), ProcessSampleDuration);
+    gtk_label_set_text(GTK_LABEL(ProcessPanelStatus), status);
+    g_free(status);
+}
+
+void SampleProcessList(GList* terminals) {
+    gint64 start = g_get_monotonic_time();
+    for (GList* l = terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        SampleProcess(state, start);
+        state->sampled_bytes = state->bytes_in + state->bytes_out;
+    }
+    ProcessSampleDuration = g_get_monotonic_time() - start;
+}
+
+gint CompareTimes(gconstpointer a, gconstpointer b) {
+    gint64 left = *(const gint64*) a;
+    gint64 right = *(const gint64*) b;
+    return (left > right) - (left < right);
+}
+
+void BenchmarkProcessSampler(guint count) {
+    GList* terminals = NULL;
+    for (guint i = 0; i < count; i++) {
+        TerminalState* state = g_new0(TerminalState, 1);
+        state->pid = getpid();
+        state->stat_fd = -1;
+        state->io_fd = -1;
+        terminals = g_list_prepend(terminals, state);
+    }
+
+    gint64 samples[PROCESS_BENCHMARK_ROUNDS];
+    SampleProcessList(terminals);
+    gint64 first = ProcessSampleDuration;
+    for (guint i = 0; i < PROCESS_BENCHMARK_ROUNDS; i++) {
+        SampleProcessList(terminals);
+        samples[i] = ProcessSampleDuration;
+    }
+    qsort(samples, PROCESS_BENCHMARK_ROUNDS, sizeof(gint64), CompareTimes);
+    g_print("Process sampler: %u terminals, first pass %" G_GINT64_FORMAT " \302\265s, median %" G_GINT64_FORMAT " \302\265s, max %" G_GINT64_FORMAT " \302\265s over %d passes\n",
+            count, first, samples[PROCESS_BENCHMARK_ROUNDS / 2], samples[PROCESS_BENCHMARK_ROUNDS - 1], PROCESS_BENCHMARK_ROUNDS);
+
+    for (GList* l = terminals; l != NULL; l = l->next) {
+        CloseProcessFiles(l->data);
+    }
+    g_list_free_full(terminals, g_free);
+}
+
+void SampleProcesses(void) {
+    SampleProcessList(Terminals);
+
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        UpdateProcessBadge(l->data);
+    }
+    RefreshProcessPanel();
+}
+
+void ObserveHistogram(MetricHistogram* histogram, gint64 value) {
+    guint bucket = 0;
+    while (bucket < METRIC_BUCKETS && value > histogram->bounds[bucket]) {
+        bucket++;
+    }
+    atomic_fetch_add_explicit(&histogram->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+}
+
+void UpdateMetricGauges(void) {
+    if (MetricsThread == NULL) {
+        return;
+    }
+    GList* windows = NULL;
+    GList* pages = NULL;
+    guint64 rows = 0, bytes = 0;
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        if (g_list_find(windows, state->window) == NULL) {
+            windows = g_list_prepend(windows, state->window);
+        }
+        if (g_list_find(pages, state->page) == NULL) {
+            pages = g_list_prepend(pages, state->page);
+        }
+        GtkAdjustment* adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(state->terminal));
+        glong terminal_rows = (glong) (gtk_adjustment_get_upper(adjustment) - gtk_adjustment_get_lower(adjustment));
+        rows += terminal_rows;
+        bytes += (guint64) terminal_rows * vte_terminal_get_column_count(VTE_TERMINAL(state->terminal)) * HUD_BYTES_PER_CELL;
+    }
+    atomic_store_explicit(&MetricWindows, g_list_length(windows), memory_order_relaxed);
+    atomic_store_explicit(&MetricTabs, g_list_length(pages), memory_order_relaxed);
+    atomic_store_explicit(&MetricTerminals, g_list_length(Terminals), memory_order_relaxed);
+    atomic_store_explicit(&MetricScrollbackRows, rows, memory_order_relaxed);
+    atomic_store_explicit(&MetricScrollbackBytes, bytes, memory_order_relaxed);
+    g_list_free(windows);
+    g_list_free(pages);
+}
+
+void AppendMetric(GString* report, const gchar* name, const gchar* type, const gchar* help, guint64 value) {
+    g_string_append_printf(report, "# HELP %s %s\n# TYPE %s %s\n%s{%s} %" G_GUINT64_FORMAT "\n",
+                           name, help, name, type, name, MetricsLabels, value);
+}
+
+void AppendHistogram(GString* report, MetricHistogram* histogram) {
+    guint64 cumulative = 0;
+    g_string_append_printf(report, "# HELP %s %s\n# TYPE %s histogram\n", histogram->name, histogram->help, histogram->name);
+    for (guint i = 0; i <= METRIC_BUCKETS; i++) {
+        cumulative += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        if (i < METRIC_BUCKETS) {
+            g_string_append_printf(report, "%s_bucket{%s,le=\"%g\"} %" G_GUINT64_FORMAT "\n",
+                                   histogram->name, MetricsLabels, histogram->bounds[i] / (gdouble) G_USEC_PER_SEC, cumulative);
+        } else {
+            g_string_append_printf(report, "%s_bucket{%s,le=\"+Inf\"} %" G_GUINT64_FORMAT "\n", histogram->name, MetricsLabels, cumulative);
+        }
+    }
+    g_string_append_printf(report, "%s_sum{%s} %g\n%s_count{%s} %" G_GUINT64_FORMAT "\n",
+                           histogram->name, MetricsLabels, atomic_load_explicit(&histogram->sum, memory_order_relaxed) / (gdouble) G_USEC_PER_SEC,
+                           histogram->name, MetricsLabels, atomic_load_explicit(&histogram->count, memory_order_relaxed));
+}
+
+void WriteMetrics(void) {
+    GString* report = g_string_new(NULL);
+    AppendMetric(report, "illumiterm_windows", "gauge", "Open windows.", atomic_load_explicit(&MetricWindows, memory_order_relaxed));
+    AppendMetric(report, "illumiterm_tabs", "gauge", "Open tabs.", atomic_load_explicit(&MetricTabs, memory_order_relaxed));
+    AppendMetric(report, "illumiterm_terminals", "gauge", "Open terminals, counting every split pane.", atomic_load_explicit(&MetricTerminals, memory_order_relaxed));
+    AppendMetric(report, "illumiterm_scrollback_rows", "gauge", "Rows held in all scrollback buffers.", atomic_load_explicit(&MetricScrollbackRows, memory_order_relaxed));
+    AppendMetric(report, "illumiterm_scrollback_bytes", "gauge", "Estimated memory held by all scrollback buffers.", atomic_load_explicit(&MetricScrollbackBytes, memory_order_relaxed));
+    AppendMetric(report, "illumiterm_pty_read_bytes_total", "counter", "Bytes read from child processes.", atomic_load_explicit(&MetricBytesIn, memory_order_relaxed));
+    AppendMetric(report, "illumiterm_pty_written_bytes_total", "counter", "Bytes written to child processes.", atomic_load_explicit(&MetricBytesOut, memory_order_relaxed));
+    AppendMetric(report, "illumiterm_frames_total", "counter", "Terminal frames drawn.", atomic_load_explicit(&MetricFrames, memory_order_relaxed));
+    AppendHistogram(report, &DispatchHistogram);
+    AppendHistogram(report, &SpawnHistogram);
+
+    GError* error = NULL;
+    if (!g_file_set_contents(MetricsPath, report->str, report->len, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+    }
+    g_string_free(report, TRUE);
+}
+
+gpointer ExportMetrics(gpointer data) {
+    g_mutex_lock(&MetricsLock);
+    while (MetricsRunning) {
+        WriteMetrics();
+        gint64 deadline = g_get_monotonic_time() + METRICS_INTERVAL * G_USEC_PER_SEC;
+        while (MetricsRunning && g_cond_wait_until(&MetricsCond, &MetricsLock, deadline)) {
+        }
+    }
+    g_mutex_unlock(&MetricsLock);
+    return NULL;
+}
+
+void SetMetricsExport(gboolean enable) {
+    if (enable && MetricsThread == NULL) {
+        gchar* directory = g_build_filename(g_get_user_runtime_dir(), "illumiterm", NULL);
+        gchar* name = g_strdup_printf("metrics-%d.prom", getpid());
+        g_mkdir_with_parents(directory, 0700);
+        MetricsPath = g_build_filename(directory, name, NULL);
+        MetricsLabels = ShardIndex > 0 ? g_strdup_printf("pid=\"%d\",shard=\"%d\"", getpid(), ShardIndex) : g_strdup_printf("pid=\"%d\"", getpid());
+        g_free(directory);
+        g_free(name);
+
+        MetricsRunning = TRUE;
+        MetricsThread = g_thread_new("metrics", ExportMetrics, NULL);
+        UpdateMetricGauges();
+    } else if (!enable && MetricsThread != NULL) {
+        g_mutex_lock(&MetricsLock);
+        MetricsRunning = FALSE;
+        g_cond_signal(&MetricsCond);
+        g_mutex_unlock(&MetricsLock);
+        g_thread_join(MetricsThread);
+        MetricsThread = NULL;
+
+        g_unlink(MetricsPath);
+        g_free(MetricsPath);
+        MetricsPath = NULL;
+        g_clear_pointer(&MetricsLabels, g_free);
+    }
+}
+
+gboolean Heartbeat(gpointer data) {
+    gboolean sample = ProcessPanel != NULL;
+    for (GList* l = Terminals; l != NULL && !sample; l = l->next) {
+        TerminalState* state = l->data;
+        sample = state->bytes_in + state->bytes_out != state->sampled_bytes;
+    }
+    if (sample && ++HeartbeatTicks % PROCESS_SAMPLE_INTERVAL == 0) {
+        SampleProcesses();
+    }
+    if (sample) {
+        UpdateMetricGauges();
+    }
+    if (CheckActivity(g_get_monotonic_time()) || sample) {
+        return G_SOURCE_CONTINUE;
+    }
+    HeartbeatSource = 0;
+    return G_SOURCE_REMOVE;
+}
+
+void WakeHeartbeat(void) {
+    if (HeartbeatSource == 0 && Terminals != NULL) {
+        HeartbeatSource = g_timeout_add_seconds(HEARTBEAT_INTERVAL, Heartbeat, NULL);
+    }
+}
+
+gint WakeupPoll(GPollFD* fds, guint nfds, gint timeout) {
+    if (PollReturned != 0) {
+        ObserveHistogram(&DispatchHistogram, g_get_monotonic_time() - PollReturned);
+    }
+    gint result = g_poll(fds, nfds, timeout);
+    if (timeout != 0) {
+        Wakeups++;
+    }
+    PollReturned = g_get_monotonic_time();
+    return result;
+}
+
+void ClearPromptMark(gpointer data) {
+    g_free(((PromptMark*) data)->command);
+}
+
+void FreeTerminalState(gpointer data) {
+    TerminalState* state = data;
+    g_free(state->badge);
+    g_free(state->cwd);
+    g_free(state->name);
+    g_byte_array_free(state->output, TRUE);
+    g_byte_array_free(state->input, TRUE);
+    g_byte_array_free(state->held, TRUE);
+    g_byte_array_free(state->image_held, TRUE);
+    g_array_free(state->prompts, TRUE);
+    g_byte_array_free(state->trigger_input, TRUE);
+    g_array_free(state->trigger_tags, TRUE);
+    g_byte_array_free(state->broadcast_input, TRUE);
+    g_free(state);
+}
+
+GByteArray* ConvertBlock(GConverter* converter, const gchar* data, gsize length, GError** error) {
+    GByteArray* output = g_byte_array_new();
+    gsize read = 0, used = 0;
+    g_byte_array_set_size(output, MAX(length, 4096));
+
+    while (TRUE) {
+        gsize consumed = 0, produced = 0;
+        GError* local = NULL;
+        GConverterResult result = g_converter_convert(converter, data + read, length - read, output->data + used, output->len - used,
+                                                      G_CONVERTER_INPUT_AT_END, &consumed, &produced, &local);
+        read += consumed;
+        used += produced;
+        if (result == G_CONVERTER_FINISHED) {
+            break;
+        }
+        if (result == G_CONVERTER_ERROR && !g_error_matches(local, G_IO_ERROR, G_IO_ERROR_NO_SPACE)) {
+            g_propagate_error(error, local);
+            g_byte_array_unref(output);
+            return NULL;
+        }
+        g_clear_error(&local);
+        if (output->len - used < output->len / 4 || (consumed == 0 && produced == 0)) {
+            g_byte_array_set_size(output, output->len * 2);
+        }
+    }
+    g_byte_array_set_size(output, used);
+    return output;
+}
+
+void ClearArchive(gpointer data) {
+    ScrollbackArchive* archive = data;
+    for (guint i = 0; i < archive->segments->len; i++) {
+        ArchiveSegment* segment = &g_array_index(archive->segments, ArchiveSegment, i);
+        close(segment->fd);
+        if (!g_atomic_int_get(&archive->keep)) {
+            g_unlink(segment->path);
+        }
+        g_free(segment->path);
+    }
+    g_free(archive->stem);
+    g_array_unref(archive->segments);
+    g_array_unref(archive->blocks);
+    g_mutex_clear(&archive->lock);
+}
+
+gboolean AddArchiveSegment(ScrollbackArchive* archive, GError** error) {
+    ArchiveSegment segment = {NULL, -1, 0};
+    segment.path = archive->segments->len == 0 ? g_strdup_printf("%s.gz", archive->stem)
+                                               : g_strdup_printf("%s.%u.gz", archive->stem, archive->segments->len);
+    segment.fd = open(segment.path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (segment.fd < 0) {
+        gint saved = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved), "Scrollback archive %s: %s", segment.path, g_strerror(saved));
+        g_free(segment.path);
+        errno = saved;
+        return FALSE;
+    }
+    g_array_append_val(archive->segments, segment);
+    return TRUE;
+}
+
+gboolean ReadArchiveSegment(gint fd, gchar* data, gsize length, guint64 offset, GError** error) {
+    gsize read = 0;
+    while (read < length) {
+        gssize result = pread(fd, data + read, length - read, offset + read);
+        if (result == 0) {
+            g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Scrollback archive is truncated");
+            return FALSE;
+        }
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            g_set_error_literal(error, G_IO_ERROR, g_io_error_from_errno(errno), g_strerror(errno));
+            return FALSE;
+        }
+        read += result;
+    }
+    return TRUE;
+}
+
+gboolean CopyArchive(ScrollbackArchive* archive, GFile* destination, GError** error) {
+    GFileOutputStream* output = g_file_replace(destination, NULL, FALSE, G_FILE_CREATE_NONE, NULL, error);
+    if (output == NULL) {
+        return FALSE;
+    }
+    g_mutex_lock(&archive->lock);
+    GArray* segments = g_array_copy(archive->segments);
+    g_mutex_unlock(&archive->lock);
+
+    gchar buffer[65536];
+    gboolean copied = TRUE;
+    for (guint i = 0; i < segments->len && copied; i++) {
+        ArchiveSegment* segment = &g_array_index(segments, ArchiveSegment, i);
+        for (guint64 offset = 0; offset < segment->size && copied; ) {
+            gsize length = MIN(sizeof(buffer), segment->size - offset);
+            copied = ReadArchiveSegment(segment->fd, buffer, length, offset, error) &&
+                     g_output_stream_write_all(G_OUTPUT_STREAM(output), buffer, length, NULL, NULL, error);
+            offset += length;
+        }
+    }
+    g_array_unref(segments);
+    copied = g_output_stream_close(G_OUTPUT_STREAM(output), NULL, copied ? error : NULL) && copied;
+    g_object_unref(output);
+    return copied;
+}
+
+void RunArchiveJob(gpointer data, gpointer user_data) {
+    ArchiveJob* job = data;
+    ScrollbackArchive* archive = job->archive;
+    GError* error = NULL;
+
+    if (job->destination != NULL) {
+        if (!CopyArchive(archive, job->destination, &error)) {
+            g_printerr("%s\n", error->message);
+            g_error_free(error);
+        }
+        g_object_unref(job->destination);
+    } else {
+        gint64 started = g_get_monotonic_time();
+        GZlibCompressor* compressor = g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+        GByteArray* block = ConvertBlock(G_CONVERTER(compressor), job->text->str, job->text->len, &error);
+        g_object_unref(compressor);
+
+        g_mutex_lock(&archive->lock);
+        ArchiveSegment segment = g_array_index(archive->segments, ArchiveSegment, archive->segments->len - 1);
+        if (block != NULL && segment.size > 0 && segment.size + block->len > ARCHIVE_SEGMENT_LIMIT) {
+            GError* local = NULL;
+            if (AddArchiveSegment(archive, &local)) {
+                segment = g_array_index(archive->segments, ArchiveSegment, archive->segments->len - 1);
+            } else {
+                g_printerr("%s\n", local->message);
+                g_error_free(local);
+            }
+        }
+        ArchiveBlock entry = {job->first_row, 0, 0, segment.size, 0, job->text->len, archive->segments->len - 1};
+        g_mutex_unlock(&archive->lock);
+        for (const gchar* p = job->text->str; (p = strchr(p, '\n')) != NULL; p++) {
+            entry.lines++;
+        }
+        if (block != NULL) {
+            gsize written = 0;
+            while (written < block->len) {
+                gssize result = pwrite(segment.fd, block->data + written, block->len - written, entry.offset + written);
+                if (result < 0 && errno != EINTR) {
+                    g_printerr("Scrollback archive %s: %s\n", segment.path, g_strerror(errno));
+                    break;
+                }
+                written += MAX(result, 0);
+            }
+            entry.length = written == block->len ? block->len : 0;
+            g_byte_array_unref(block);
+        } else {
+            g_printerr("Scrollback archive %s: %s\n", segment.path, error->message);
+            g_error_free(error);
+        }
+
+        g_mutex_lock(&archive->lock);
+        if (entry.length > 0) {
+            entry.first_line = archive->lines;
+            g_array_append_val(archive->blocks, entry);
+            g_array_index(archive->segments, ArchiveSegment, entry.segment).size += entry.length;
+            archive->lines += entry.lines;
+            archive->size += entry.length;
+            archive->raw_size += entry.raw_length;
+        }
+        archive->write_time += g_get_monotonic_time() - started;
+        g_mutex_unlock(&archive->lock);
+        g_string_free(job->text, TRUE);
+    }
+    g_atomic_rc_box_release_full(archive, ClearArchive);
+    g_free(job);
+    g_atomic_int_add(&ArchiveJobsPending, -1);
+}
+
+void QueueArchiveJob(ScrollbackArchive* archive, GString* text, glong first_row, GFile* destination) {
+    if (ArchivePool == NULL) {
+        ArchivePool = g_thread_pool_new(RunArchiveJob, NULL, 1, FALSE, NULL);
+    }
+    ArchiveJob* job = g_new0(ArchiveJob, 1);
+    job->archive = g_atomic_rc_box_acquire(archive);
+    job->text = text;
+    job->first_row = first_row;
+    job->destination = destination;
+    g_atomic_int_inc(&ArchiveJobsPending);
+    g_thread_pool_push(ArchivePool, job, NULL);
+}
+
+void FlushArchive(ScrollbackArchive* archive) {
+    if (archive->pending->len > 0) {
+        QueueArchiveJob(archive, archive->pending, archive->pending_row, NULL);
+        archive->pending = g_string_new(NULL);
+    }
+    archive->pending_row = archive->next_row;
+}
+
+void ArchiveRows(TerminalState* state) {
+    ScrollbackArchive* archive = state->archive;
+    VteTerminal* terminal = VTE_TERMINAL(state->terminal);
+    GtkAdjustment* adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(state->terminal));
+    glong lower = (glong) gtk_adjustment_get_lower(adjustment);
+    glong end = (glong) gtk_adjustment_get_upper(adjustment) - vte_terminal_get_row_count(terminal) - archive->limit;
+
+    if (archive->next_row < lower) {
+        FlushArchive(archive);
+        archive->next_row = archive->pending_row = lower;
+    }
+    while (archive->next_row < end) {
+        glong last = MIN(end, archive->pending_row + ARCHIVE_BLOCK_ROWS) - 1;
+        gchar* text = vte_terminal_get_text_range(terminal, archive->next_row, 0, last, vte_terminal_get_column_count(terminal) - 1, NULL, NULL, NULL);
+        if (text != NULL) {
+            g_string_append(archive->pending, text);
+            if (!g_str_has_suffix(text, "\n")) {
+                g_string_append_c(archive->pending, '\n');
+            }
+            g_free(text);
+        }
+        archive->next_row = last + 1;
+        if (archive->next_row - archive->pending_row >= ARCHIVE_BLOCK_ROWS) {
+            FlushArchive(archive);
+        }
+    }
+}
+
+void StopArchive(TerminalState* state) {
+    if (state->archive != NULL) {
+        FlushArchive(state->archive);
+        g_string_free(state->archive->pending, TRUE);
+        g_atomic_rc_box_release_full(state->archive, ClearArchive);
+        state->archive = NULL;
+    }
+}
+
+void UpdateArchive(TerminalState* state, glong limit) {
+    if (limit <= 0) {
+        StopArchive(state);
+        return;
+    }
+    if (state->archive == NULL) {
+        gchar* directory = g_build_filename(g_get_user_cache_dir(), "illumiterm", NULL);
+        g_mkdir_with_parents(directory, 0700);
+        ScrollbackArchive* archive = g_atomic_rc_box_new0(ScrollbackArchive);
+        g_mutex_init(&archive->lock);
+        archive->segments = g_array_new(FALSE, FALSE, sizeof(ArchiveSegment));
+        archive->blocks = g_array_new(FALSE, FALSE, sizeof(ArchiveBlock));
+        GError* error = NULL;
+        do {
+            g_clear_error(&error);
+            g_free(archive->stem);
+            archive->stem = g_strdup_printf("%s/scrollback-%d-%u", directory, getpid(), ++ArchiveCount);
+        } while (!AddArchiveSegment(archive, &error) && g_error_matches(error, G_IO_ERROR, G_IO_ERROR_EXISTS));
+        g_free(directory);
+        if (error != NULL) {
+            g_printerr("%s\n", error->message);
+            g_error_free(error);
+            g_atomic_rc_box_release_full(archive, ClearArchive);
+            return;
+        }
+        archive->pending = g_string_new(NULL);
+        archive->next_row = archive->pending_row = (glong) gtk_adjustment_get_lower(gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(state->terminal)));
+        state->archive = archive;
+    }
+    state->archive->limit = limit;
+    ArchiveRows(state);
+}
+
+gchar* ReadArchiveBlock(ScrollbackArchive* archive, const ArchiveBlock* block, GError** error) {
+    g_mutex_lock(&archive->lock);
+    gint fd = g_array_index(archive->segments, ArchiveSegment, block->segment).fd;
+    g_mutex_unlock(&archive->lock);
+    gchar* data = g_malloc(block->length);
+    if (!ReadArchiveSegment(fd, data, block->length, block->offset, error)) {
+        g_free(data);
+        return NULL;
+    }
+    GZlibDecompressor* decompressor = g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+    GByteArray* text = ConvertBlock(G_CONVERTER(decompressor), data, block->length, error);
+    g_object_unref(decompressor);
+    g_free(data);
+    if (text == NULL) {
+        return NULL;
+    }
+    g_byte_array_append(text, (const guint8*) "", 1);
+    return (gchar*) g_byte_array_free(text, FALSE);
+}
+
+gchar* SeekArchiveLine(ScrollbackArchive* archive, guint64 line, GError** error) {
+    g_mutex_lock(&archive->lock);
+    guint low = 0, high = archive->blocks->len;
+    while (low < high) {
+        guint middle = (low + high) / 2;
+        if (g_array_index(archive->blocks, ArchiveBlock, middle).first_line <= line) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    ArchiveBlock block = {0};
+    gboolean found = low > 0 && line < archive->lines;
+    if (found) {
+        block = g_array_index(archive->blocks, ArchiveBlock, low - 1);
+    }
+    g_mutex_unlock(&archive->lock);
+    if (!found) {
+        return NULL;
+    }
+
+    gchar* text = ReadArchiveBlock(archive, &block, error);
+    if (text == NULL) {
+        return NULL;
+    }
+    const gchar* start = text;
+    for (guint64 i = block.first_line; i < line && strchr(start, '\n') != NULL; i++) {
+        start = strchr(start, '\n') + 1;
+    }
+    gchar* result = g_strndup(start, strcspn(start, "\n"));
+    g_free(text);
+    return result;
+}
+
+void DropImages(TerminalState* state) {
+    GList* l = Images.head;
+    while (l != NULL) {
+        GList* next = l->next;
+        InlineImage* image = l->data;
+        if (state == NULL || image->state == state) {
+            ImageBytes -= image->bytes;
+            g_free(image);
+            g_queue_delete_link(&Images, l);
+        }
+        l = next;
+    }
+}
+
+void PruneImages(void) {
+    GList* l = Images.head;
+    while (l != NULL) {
+        GList* next = l->next;
+        InlineImage* image = l->data;
+        GtkAdjustment* adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(image->state->terminal));
+        if (image->row < (glong) gtk_adjustment_get_lower(adjustment)) {
+            ImageBytes -= image->bytes;
+            g_free(image);
+            g_queue_delete_link(&Images, l);
+        }
+        l = next;
+    }
+}
+
+InlineImage* AdmitImage(TerminalState* state, gsize bytes) {
+    gsize limit = (gsize) CurrentSettings->image_memory * 1024 * 1024;
+    if (ImageBytes + bytes > limit) {
+        PruneImages();
+    }
+    if (ImageBytes + bytes > limit) {
+        return NULL;
+    }
+    InlineImage* image = g_new0(InlineImage, 1);
+    image->state = state;
+    image->bytes = bytes;
+    image->row = G_MAXLONG;
+    g_queue_push_tail(&Images, image);
+    ImageBytes += bytes;
+    state->images_unplaced++;
+    return image;
+}
+
+guint64 NextImageEnd(TerminalState* state) {
+    for (GList* l = Images.head; l != NULL; l = l->next) {
+        InlineImage* image = l->data;
+        if (image->state == state && image->row == G_MAXLONG && image->end > state->fed_total) {
+            return image->end;
+        }
+    }
+    return 0;
+}
+
+void PlaceImages(TerminalState* state) {
+    glong column = 0, row = 0;
+    vte_terminal_get_cursor_position(VTE_TERMINAL(state->terminal), &column, &row);
+    for (GList* l = Images.head; l != NULL && state->images_unplaced > 0; l = l->next) {
+        InlineImage* image = l->data;
+        if (image->state == state && image->row == G_MAXLONG && image->end > 0 && image->end <= state->fed_total) {
+            image->row = row;
+            state->images_unplaced--;
+        }
+    }
+}
+
+void DropImage(TerminalState* state, GByteArray** output, const guint8* data, gsize copied, gssize start) {
+    if (*output == NULL) {
+        *output = g_byte_array_sized_new(state->input->len);
+    }
+    g_byte_array_append(*output, data + copied, start - copied);
+    state->image_dropped = TRUE;
+    state->images_dropped++;
+}
+
+void EndImage(TerminalState* state, GByteArray* output, gsize copied, gsize position) {
+    InlineImage* image = state->image_current;
+    if (image != NULL) {
+        image->end = state->held_total + (output != NULL ? output->len : 0) + position - copied;
+        state->image_current = NULL;
+    }
+}
+
+void FilterImages(TerminalState* state) {
+    GByteArray* output = NULL;
+    gsize copied = 0;
+    gssize start = -1;
+    gsize i = 0;
+
+    if (state->image_held->len > 0) {
+        g_byte_array_prepend(state->input, state->image_held->data, state->image_held->len);
+        i = state->image_held->len;
+        start = 0;
+        g_byte_array_set_size(state->image_held, 0);
+    }
+    const guint8* data = state->input->data;
+    gsize length = state->input->len;
+    gsize limit = (gsize) CurrentSettings->image_memory * 1024 * 1024;
+
+    while (i < length) {
+        if (state->image_scan == IMAGE_SCAN_TEXT) {
+            const guint8* escape = memchr(data + i, '\033', length - i);
+            if (escape == NULL) {
+                break;
+            }
+            i = escape - data;
+        }
+        guint8 c = data[i++];
+        switch (state->image_scan) {
+        case IMAGE_SCAN_TEXT:
+            start = i - 1;
+            state->image_scan = IMAGE_SCAN_ESCAPE;
+            break;
+        case IMAGE_SCAN_ESCAPE:
+            state->image_scan = c == 'P' ? IMAGE_SCAN_PARAMS : IMAGE_SCAN_TEXT;
+            state->image_field = 0;
+            i -= c == '\033';
+            break;
+        case IMAGE_SCAN_PARAMS:
+            if (c == 'q') {
+                state->image_scan = IMAGE_SCAN_RASTER;
+                state->image_field = 0;
+                state->image_body = 0;
+                memset(state->image_raster, 0, sizeof(state->image_raster));
+            } else if ((!g_ascii_isdigit(c) && c != ';') || ++state->image_field > IMAGE_PARAMS_LIMIT) {
+                state->image_scan = IMAGE_SCAN_TEXT;
+                i -= c == '\033';
+            }
+            break;
+        case IMAGE_SCAN_RASTER:
+            if (state->image_field == 0 && c == '"') {
+                state->image_field = 1;
+            } else if (state->image_field > 0 && g_ascii_isdigit(c)) {
+                guint* value = &state->image_raster[MIN(state->image_field, 4) - 1];
+                *value = MIN(*value * 10 + c - '0', 100000);
+            } else if (state->image_field > 0 && state->image_field < 4 && c == ';') {
+                state->image_field++;
+            } else {
+                gsize bytes = (gsize) state->image_raster[2] * state->image_raster[3] * IMAGE_BYTES_PER_PIXEL;
+                state->image_scan = IMAGE_SCAN_BODY;
+                i--;
+                if (bytes == 0) {
+                    break;
+                }
+                state->image_current = AdmitImage(state, bytes);
+                if (state->image_current != NULL) {
+                    state->image_body = G_MAXSIZE;
+                    break;
+                }
+                DropImage(state, &output, data, copied, start);
+            }
+            break;
+        case IMAGE_SCAN_BODY:
+            if (c == '\033') {
+                state->image_scan = IMAGE_SCAN_BODY_ESCAPE;
+            } else if (c == 0x18 || c == 0x1a) {
+                state->image_scan = IMAGE_SCAN_TEXT;
+                start = -1;
+                EndImage(state, output, copied, i);
+                if (state->image_dropped) {
+                    copied = i;
+                    state->image_dropped = FALSE;
+                }
+            } else if (state->image_body != G_MAXSIZE && !state->image_dropped &&
+                       ++state->image_body * IMAGE_PIXELS_PER_BYTE * IMAGE_BYTES_PER_PIXEL > limit) {
+                DropImage(state, &output, data, copied, start);
+            }
+            break;
+        case IMAGE_SCAN_BODY_ESCAPE:
+            if (state->image_body != G_MAXSIZE && !state->image_dropped) {
+                state->image_current = AdmitImage(state, state->image_body * IMAGE_PIXELS_PER_BYTE * IMAGE_BYTES_PER_PIXEL);
+                if (state->image_current == NULL) {
+                    DropImage(state, &output, data, copied, start);
+                }
+            }
+            state->image_scan = c == '\\' ? IMAGE_SCAN_TEXT : IMAGE_SCAN_ESCAPE;
+            start = c == '\\' ? -1 : (gssize) i - 2;
+            i -= c != '\\';
+            EndImage(state, output, copied, c == '\\' ? i : i - 1);
+            if (state->image_dropped) {
+                copied = c == '\\' || i == 0 ? i : i - 1;
+                state->image_dropped = FALSE;
+            }
+            break;
+        }
+    }
+
+    gsize end = length;
+    if (state->image_dropped) {
+        copied = length;
+    } else if (state->image_scan >= IMAGE_SCAN_PARAMS && start >= 0 &&
+               (state->image_scan < IMAGE_SCAN_BODY || state->image_body != G_MAXSIZE)) {
+        g_byte_array_append(state->image_held, data + start, length - start);
+        end = start;
+    }
+    if (output != NULL || copied > 0 || end < length) {
+        if (output == NULL) {
+            output = g_byte_array_sized_new(end - copied);
+        }
+        g_byte_array_append(output, data + copied, end - copied);
+        g_byte_array_unref(state->input);
+        state->input = output;
+    }
+}
+
+void DropThumbnail(TerminalState* state) {
+    if (state->thumbnail != NULL) {
+        ThumbnailBytes -= cairo_image_surface_get_stride(state->thumbnail) * cairo_image_surface_get_height(state->thumbnail);
+        ThumbnailCount--;
+        cairo_surface_destroy(state->thumbnail);
+        state->thumbnail = NULL;
+        if (state->overview_item != NULL) {
+            gtk_image_clear(GTK_IMAGE(g_object_get_data(G_OBJECT(state->overview_item), "image")));
+        }
+    }
+}
+
+void StopSearch(void) {
+    if (SearchCancellable != NULL) {
+        g_cancellable_cancel(SearchCancellable);
+        g_clear_object(&SearchCancellable);
+    }
+    if (SearchSource != 0) {
+        g_source_remove(SearchSource);
+        SearchSource = 0;
+    }
+    g_clear_pointer(&SearchRegex, g_regex_unref);
+}
+
+void UnregisterTerminal(GtkWidget* terminal, gpointer data) {
+    TerminalState* state = data;
+    CloseProcessFiles(state);
+    Terminals = g_list_remove(Terminals, state);
+    state->closed = TRUE;
+    StopArchive(state);
+    DropImages(state);
+    DropThumbnail(state);
+    if (state->overview_item != NULL) {
+        GtkWidget* item = state->overview_item;
+        g_object_remove_weak_pointer(G_OBJECT(item), (gpointer*) &state->overview_item);
+        state->overview_item = NULL;
+        gtk_widget_destroy(item);
+    }
+
+    if (ActiveTerminal == terminal) {
+        ActiveTerminal = NULL;
+    }
+    if (CommandPanelTerminal == state) {
+        CommandPanelTerminal = NULL;
+        gtk_list_store_clear(CommandStore);
+    }
+    if (SearchTerminal == state) {
+        SearchTerminal = NULL;
+        StopSearch();
+        gtk_list_store_clear(SearchStore);
+    }
+    if (state->read_source != 0) {
+        g_source_remove(state->read_source);
+        state->read_source = 0;
+    }
+    if (state->write_source != 0) {
+        g_source_remove(state->write_source);
+        state->write_source = 0;
+    }
+    g_clear_object(&state->pty);
+
+    if (state->rewrap_source != 0) {
+        g_source_remove(state->rewrap_source);
+        state->rewrap_source = 0;
+    }
+    if (state->feed_source != 0) {
+        g_source_remove(state->feed_source);
+        state->feed_source = 0;
+    }
+    if (state->size_tick != 0) {
+        gtk_widget_remove_tick_callback(terminal, state->size_tick);
+        state->size_tick = 0;
+    }
+    if (state->size_settle_source != 0) {
+        g_source_remove(state->size_settle_source);
+        state->size_settle_source = 0;
+    }
+    if (state->hud_draw_handler != 0 && --HudCount == 0 && HudSource != 0) {
+        g_source_remove(HudSource);
+        HudSource = 0;
+    }
+
+    if (Terminals == NULL && HeartbeatSource != 0) {
+        g_source_remove(HeartbeatSource);
+        HeartbeatSource = 0;
+    }
+    if (Terminals == NULL && BroadcastSource != 0) {
+        g_source_remove(BroadcastSource);
+        BroadcastSource = 0;
+    }
+    if (Terminals == NULL && ThumbnailSource != 0) {
+        g_source_remove(ThumbnailSource);
+        ThumbnailSource = 0;
+    }
+    UpdateMetricGauges();
+}
+
+void RegisterTerminal(GtkWidget* terminal, GtkWidget* window) {
+    TerminalState* state = g_new0(TerminalState, 1);
+    state->terminal = terminal;
+    state->window = window;
+    state->tab_label = g_object_get_data(G_OBJECT(terminal), "tab-label");
+    state->page = g_object_get_data(G_OBJECT(terminal), "page");
+    state->overlay = g_object_get_data(G_OBJECT(terminal), "overlay");
+    state->stat_fd = -1;
+    state->io_fd = -1;
+    state->output = g_byte_array_new();
+    state->input = g_byte_array_new();
+    state->held = g_byte_array_new();
+    state->image_held = g_byte_array_new();
+    state->prompts = g_array_new(FALSE, FALSE, sizeof(PromptMark));
+    g_array_set_clear_func(state->prompts, ClearPromptMark);
+    state->trigger_input = g_byte_array_new();
+    state->trigger_tags = g_array_new(FALSE, FALSE, sizeof(gint));
+    state->broadcast_input = g_byte_array_new();
+
+    g_object_set_data_full(G_OBJECT(terminal), "state", state, FreeTerminalState);
+    g_signal_connect(terminal, "destroy", G_CALLBACK(UnregisterTerminal), state);
+    Terminals = g_list_append(Terminals, state);
+
+    WakeHeartbeat();
+    UpdateMetricGauges();
+}
+
+gboolean WindowsSpread(const gchar* feature) {
+    if (ShardIndex == 0 && ShardNext == 0) {
+        return FALSE;
+    }
+    g_printerr("%s is not available while windows are spread across processes\n", feature);
+    return TRUE;
+}
+
+void ProcessMonitor(void) {
+    if (WindowsSpread("Process Monitor")) {
+        return;
+    }
+    if (ProcessPanel != NULL) {
+        gtk_window_present(GTK_WINDOW(ProcessPanel));
+        return;
+    }
+
+    ProcessPanel = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(ProcessPanel), "Process Monitor");
+    gtk_window_set_default_size(GTK_WINDOW(ProcessPanel), 640, 300);
+    gtk_window_set_icon_from_file(GTK_WINDOW(ProcessPanel), "/usr/share/icons/hicolor/48x48/apps/illumiterm.png", NULL);
+    g_signal_connect(ProcessPanel, "destroy", G_CALLBACK(gtk_widget_destroyed), &ProcessPanel);
+
+    ProcessStore = gtk_list_store_new(PROCESS_NUM_COLUMNS, G_TYPE_STRING, G_TYPE_INT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+    GtkWidget* tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(ProcessStore));
+    g_object_unref(ProcessStore);
+
+    const gchar* titles[] = {"Tab", "PID", "Process", "CPU", "RSS", "I/O"};
+    for (int i = 0; i < G_N_ELEMENTS(titles); i++) {
+        gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(tree_view), -1, titles[i], gtk_cell_renderer_text_new(), "text", i, NULL);
+    }
+
+    GtkWidget* scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), tree_view);
+
+    ProcessPanelStatus = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(ProcessPanelStatus), 0.0);
+    gtk_widget_set_margin_start(ProcessPanelStatus, 5);
+
+    GtkWidget* vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_box_pack_start(GTK_BOX(vbox), scrolled_window, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), ProcessPanelStatus, FALSE, FALSE, 5);
+    gtk_container_add(GTK_CONTAINER(ProcessPanel), vbox);
+
+    SampleProcesses();
+    WakeHeartbeat();
+    gtk_widget_show_all(ProcessPanel);
+}
+
+const gchar* GetNewWindowTitle(VteTerminal* terminal) {
+    return vte_terminal_get_window_title(terminal);
+}
+
+void SetWindowTitle(GtkWidget* window, const gchar* newTitle) {
+    gtk_window_set_title(GTK_WINDOW(window), newTitle);
+}
+
+void WindowTitleChanged(GtkWidget* widget, gpointer window) {
+    TerminalState* state = GetTerminalState(widget);
+    if (state != NULL) {
+        UpdateTabLabel(state);
+    }
+    if (state == NULL || (IsCurrentTab(state) && IsFocusedPane(state))) {
+        const gchar* new_title = GetNewWindowTitle(VTE_TERMINAL(widget));
+        SetWindowTitle(GTK_WIDGET(window), new_title);
+    }
+}
+
+void SetExitStatus(GApplicationCommandLine* cli, gint status) {
+    if (cli != NULL) {
+        g_application_command_line_set_exit_status(cli, status);
+    }
+}
+
+void DestroyWindow(GtkWidget* widget, gpointer data) {
+    if (widget != NULL) {
+        gtk_widget_destroy(widget);
+    }
+}
+
+void DestroyAndQuit(GtkWidget* window, gint status) {
+    GApplicationCommandLine* cli = g_object_get_data(G_OBJECT(window), "cli");
+    if (cli != NULL) {
+        SetExitStatus(cli, status);
+    }
+    DestroyWindow(window, NULL);
+}
+
+void HandleChildExit(GtkWidget* window, gint status) {
+    DestroyAndQuit(window, status);
+}
+
+GtkWidget* CreatePane(GtkWidget* widget) {
+    GtkWidget* scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), widget);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_ALWAYS);
+    gtk_scrolled_window_set_min_content_height(GTK_SCROLLED_WINDOW(scrolled_window), 200);
+
+    GtkWidget* overlay = gtk_overlay_new();
+    gtk_container_add(GTK_CONTAINER(overlay), scrolled_window);
+    g_object_set_data(G_OBJECT(widget), "overlay", overlay);
+    g_object_set_data(G_OBJECT(overlay), "terminal", widget);
+
+    return overlay;
+}
+
+GtkWidget* GetPaneTerminal(GtkWidget* pane) {
+    while (GTK_IS_PANED(pane)) {
+        pane = gtk_paned_get_child1(GTK_PANED(pane));
+    }
+    return g_object_get_data(G_OBJECT(pane), "terminal");
+}
+
+void ReplacePane(GtkWidget* pane, GtkWidget* replacement) {
+    GtkWidget* parent = gtk_widget_get_parent(pane);
+    if (GTK_IS_PANED(parent)) {
+        gboolean first = gtk_paned_get_child1(GTK_PANED(parent)) == pane;
+        gtk_container_remove(GTK_CONTAINER(parent), pane);
+        if (first) {
+            gtk_paned_pack1(GTK_PANED(parent), replacement, TRUE, FALSE);
+        } else {
+            gtk_paned_pack2(GTK_PANED(parent), replacement, TRUE, FALSE);
+        }
+    } else {
+        gtk_container_remove(GTK_CONTAINER(parent), pane);
+        gtk_box_pack_start(GTK_BOX(parent), replacement, TRUE, TRUE, 0);
+    }
+}
+
+gboolean RemovePane(TerminalState* state) {
+    GtkWidget* paned = gtk_widget_get_parent(state->overlay);
+    if (!GTK_IS_PANED(paned)) {
+        return FALSE;
+    }
+    GtkWidget* page = state->page;
+    GtkWidget* sibling = gtk_paned_get_child1(GTK_PANED(paned));
+    if (sibling == state->overlay) {
+        sibling = gtk_paned_get_child2(GTK_PANED(paned));
+    }
+
+    g_object_ref(paned);
+    g_object_ref(sibling);
+    gtk_container_remove(GTK_CONTAINER(paned), sibling);
+    ReplacePane(paned, sibling);
+    gtk_widget_destroy(paned);
+    g_object_unref(paned);
+    g_object_unref(sibling);
+
+    GtkWidget* terminal = GetPaneTerminal(sibling);
+    g_object_set_data(G_OBJECT(page), "terminal", terminal);
+    if (ActiveTerminal == NULL) {
+        ActiveTerminal = terminal;
+    }
+    UpdateTabLabel(GetTerminalState(terminal));
+    gtk_widget_grab_focus(terminal);
+    return TRUE;
+}
+
+gboolean BenchmarkFinished(gpointer data) {
+    GList* windows = NULL;
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        if (g_object_get_data(G_OBJECT(state->terminal), "benchmark") != NULL && g_list_find(windows, state->window) == NULL) {
+            windows = g_list_prepend(windows, state->window);
+        }
+    }
+    for (GList* l = windows; l != NULL; l = l->next) {
+        HandleChildExit(l->data, 0);
+    }
+    g_list_free(windows);
+    return G_SOURCE_REMOVE;
+}
+
+gboolean BenchmarkFrame(GtkWidget* widget, cairo_t* cr, gpointer data) {
+    BenchmarkFrames++;
+    return FALSE;
+}
+
+void PrintArchiveBenchmark(void) {
+    guint64 lines = 0, size = 0, raw_size = 0;
+    gint64 write_time = 0;
+    ScrollbackArchive* sample = NULL;
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        if (g_object_get_data(G_OBJECT(state->terminal), "benchmark") != NULL && state->archive != NULL) {
+            FlushArchive(state->archive);
+        }
+    }
+    while (g_atomic_int_get(&ArchiveJobsPending) > 0) {
+        g_usleep(1000);
+    }
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        ScrollbackArchive* archive = state->archive;
+        if (g_object_get_data(G_OBJECT(state->terminal), "benchmark") == NULL || archive == NULL) {
+            continue;
+        }
+        lines += archive->lines;
+        size += archive->size;
+        raw_size += archive->raw_size;
+        write_time += archive->write_time;
+        sample = archive->lines > 0 ? archive : sample;
+    }
+    if (sample == NULL) {
+        g_print("Archive: nothing was trimmed from a %d row scrollback\n", ARCHIVE_BENCHMARK_SCROLLBACK);
+        return;
+    }
+
+    gint64 started = g_get_monotonic_time();
+    for (gint i = 0; i < ARCHIVE_BENCHMARK_SEEKS; i++) {
+        g_free(SeekArchiveLine(sample, g_random_int_range(0, (gint32) MIN(sample->lines, G_MAXINT32)), NULL));
+    }
+    gint64 seek_time = g_get_monotonic_time() - started;
+
+    gchar* raw = g_format_size(raw_size);
+    gchar* stored = g_format_size(size);
+    g_print("Archive: %" G_GUINT64_FORMAT " lines, %s compressed to %s (%.1fx), %.1f MiB/s written, %.0f us per random line seek\n",
+            lines, raw, stored, size > 0 ? raw_size / (gdouble) size : 0.0,
+            write_time > 0 ? raw_size / (write_time / (gdouble) G_USEC_PER_SEC) / (1024 * 1024) : 0.0,
+            seek_time / (gdouble) ARCHIVE_BENCHMARK_SEEKS);
+    g_free(raw);
+    g_free(stored);
+}
+
+gboolean BenchmarkDrawn(GtkWidget* widget, cairo_t* cr, gpointer data) {
+    gdouble seconds = (g_get_monotonic_time() - BenchmarkStarted) / (gdouble) G_USEC_PER_SEC;
+    guint64 bytes = 0;
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        if (g_object_get_data(G_OBJECT(state->terminal), "benchmark") != NULL) {
+            bytes += state->bytes_in;
+        }
+    }
+    g_signal_handlers_disconnect_by_func(widget, BenchmarkDrawn, data);
+
+    gchar* size = g_format_size(bytes);
+    g_print("Throughput: %s in %.2f s, %.1f MiB/s across %d pane(s) in %d window(s) (accessibility bridge %s)\n",
+            size, seconds, bytes / seconds / (1024 * 1024), BenchmarkPanes, BenchmarkWindows,
+            g_strcmp0(g_getenv("NO_AT_BRIDGE"), "1") == 0 ? "disabled" : "enabled");
+    g_print("Repaints: %" G_GUINT64_FORMAT " terminal draws (%.1f/s), %" G_GUINT64_FORMAT " feed batches\n",
+            BenchmarkFrames, BenchmarkFrames / seconds, FeedBatches);
+    g_free(size);
+    if (BenchmarkArchive) {
+        PrintArchiveBenchmark();
+    }
+
+    g_idle_add(BenchmarkFinished, NULL);
+    return FALSE;
+}
+
+gboolean ChildExited(VteTerminal* term, gint status, gpointer data) {
+    GtkWidget* window = GTK_WIDGET(data);
+    TerminalState* state = GetTerminalState(GTK_WIDGET(term));
+    if (g_object_get_data(G_OBJECT(term), "benchmark") != NULL) {
+        if (--BenchmarkPending == 0) {
+            g_signal_connect_after(term, "draw", G_CALLBACK(BenchmarkDrawn), NULL);
+            gtk_widget_queue_draw(GTK_WIDGET(term));
+        }
+        return TRUE;
+    }
+    if (state != NULL && RemovePane(state)) {
+        return TRUE;
+    }
+    GtkWidget* notebook = GetWindowNotebook(window);
+    if (state != NULL && gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) > 1) {
+        gtk_widget_destroy(state->page);
+    } else {
+        HandleChildExit(window, status);
+    }
+    return TRUE;
+}
+
+void NewWindow(void) {
+    GError *error = NULL;
+    gchar *argv[] = {"illumiterm", NULL};
+    TerminalState *state = GetActiveTerminalState();
+    const gchar *directory = state != NULL ? state->cwd : NULL;
+
+    if (!g_spawn_async(directory, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, NULL, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+    }
+}
+
+void SetNotebookShowTabs(GtkWidget* notebook) {
+    gtk_notebook_set_show_tabs(GTK_NOTEBOOK(notebook), gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) > 1);
+}
+
+gint AddTerminalPage(GtkWidget* notebook, GtkWidget* widget) {
+    GtkWidget* page = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+    gtk_box_pack_start(GTK_BOX(page), CreatePane(widget), TRUE, TRUE, 0);
+    g_object_set_data(G_OBJECT(widget), "page", page);
+    g_object_set_data(G_OBJECT(page), "terminal", widget);
+
+    GtkWidget* tab_label = gtk_label_new("Tab");
+    g_object_set_data(G_OBJECT(widget), "tab-label", tab_label);
+    gint index = gtk_notebook_append_page(GTK_NOTEBOOK(notebook), page, tab_label);
+    gtk_notebook_set_tab_reorderable(GTK_NOTEBOOK(notebook), page, TRUE);
+    gtk_widget_show_all(page);
+
+    return index;
+}
+
+void TabSwitched(GtkNotebook* notebook, GtkWidget* page, guint page_num, gpointer data) {
+    GtkWidget* terminal = g_object_get_data(G_OBJECT(page), "terminal");
+    TerminalState* state = GetTerminalState(terminal);
+    if (state == NULL) {
+        return;
+    }
+    state->seen_output = state->last_output;
+    SetTabActivity(state, TAB_NORMAL);
+    SetWindowTitle(state->window, GetNewWindowTitle(VTE_TERMINAL(terminal)));
+    UpdateWindowCursorBlink(state->window);
+    gtk_widget_grab_focus(terminal);
+}
+
+void SpawnVteTerminal(GApplicationCommandLine* cli, GtkWidget* window, GtkWidget* widget, const gchar* command, const gchar* directory, gint* input);
+
+void OpenTab(TerminalState* state, const gchar* command, gint* input) {
+    GtkWidget* window = state->window;
+    GtkWidget* notebook = GetWindowNotebook(window);
+    GtkWidget* widget = vte_terminal_new();
+    gint page = AddTerminalPage(notebook, widget);
+
+    SpawnVteTerminal(g_object_get_data(G_OBJECT(window), "cli"), window, widget, command, state->cwd, input);
+    gtk_notebook_set_current_page(GTK_NOTEBOOK(notebook), page);
+}
+
+void NewTab(void) {
+    TerminalState* state = GetActiveTerminalState();
+    if (state != NULL) {
+        OpenTab(state, NULL, NULL);
+    }
+}
+
+void PreviousTab(void) {
+    TerminalState* state = GetActiveTerminalState();
+    if (state != NULL) {
+        gtk_notebook_prev_page(GTK_NOTEBOOK(GetWindowNotebook(state->window)));
+    }
+}
+
+void NextTab(void) {
+    TerminalState* state = GetActiveTerminalState();
+    if (state != NULL) {
+        gtk_notebook_next_page(GTK_NOTEBOOK(GetWindowNotebook(state->window)));
+    }
+}
+
+void MoveTab(gint offset) {
+    TerminalState* state = GetActiveTerminalState();
+    if (state == NULL) {
+        return;
+    }
+    GtkNotebook* notebook = GTK_NOTEBOOK(GetWindowNotebook(state->window));
+    gint page = gtk_notebook_page_num(notebook, state->page) + offset;
+    if (page >= 0 && page < gtk_notebook_get_n_pages(notebook)) {
+        gtk_notebook_reorder_child(notebook, state->page, page);
+    }
+}
+
+void MoveTabLeft(void) {
+    MoveTab(-1);
+}
+
+void MoveTabRight(void) {
+    MoveTab(1);
+}
+
+void CloseTab(void) {
+    TerminalState* state = GetActiveTerminalState();
+    if (state == NULL) {
+        return;
+    }
+    if (gtk_notebook_get_n_pages(GTK_NOTEBOOK(GetWindowNotebook(state->window))) > 1) {
+        gtk_widget_destroy(state->page);
+    } else {
+        DestroyAndQuit(state->window, 0);
+    }
+}
+
+GtkWidget* SplitTerminal(TerminalState* state, GtkOrientation orientation, const gchar* command) {
+    GtkWidget* widget = vte_terminal_new();
+    GtkWidget* pane = CreatePane(widget);
+    GtkWidget* paned = gtk_paned_new(orientation);
+    g_object_set_data(G_OBJECT(widget), "page", state->page);
+    g_object_set_data(G_OBJECT(widget), "tab-label", state->tab_label);
+
+    GtkAllocation allocation;
+    gtk_widget_get_allocation(state->overlay, &allocation);
+    g_object_ref(state->overlay);
+    ReplacePane(state->overlay, paned);
+    gtk_paned_pack1(GTK_PANED(paned), state->overlay, TRUE, FALSE);
+    gtk_paned_pack2(GTK_PANED(paned), pane, TRUE, FALSE);
+    g_object_unref(state->overlay);
+    gtk_paned_set_position(GTK_PANED(paned), (orientation == GTK_ORIENTATION_HORIZONTAL ? allocation.width : allocation.height) / 2);
+    gtk_widget_show_all(paned);
+
+    SpawnVteTerminal(g_object_get_data(G_OBJECT(state->window), "cli"), state->window, widget, command, state->cwd, NULL);
+    return widget;
+}
+
+void SplitHorizontally(void) {
+    TerminalState* state = GetActiveTerminalState();
+    if (state != NULL) {
+        gtk_widget_grab_focus(SplitTerminal(state, GTK_ORIENTATION_VERTICAL, NULL));
+    }
+}
+
+void SplitVertically(void) {
+    TerminalState* state = GetActiveTerminalState();
+    if (state != NULL) {
+        gtk_widget_grab_focus(SplitTerminal(state, GTK_ORIENTATION_HORIZONTAL, NULL));
+    }
+}
+
+void ClosePane(void) {
+    TerminalState* state = GetActiveTerminalState();
+    if (state != NULL && !RemovePane(state)) {
+        CloseTab();
+    }
+}
+
+void FinishScrollbackExport(ScrollbackExport* export, GError* error) {
+    if (error != NULL && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE)) {
+        gchar* size = g_format_size(export->written);
+        g_printerr("Scrollback export to %s stopped after %s: %s\n", export->target, size, error->message);
+        g_free(size);
+    }
+    if (export->connection != NULL) {
+        g_io_stream_close(export->connection, NULL, NULL);
+        g_object_unref(export->connection);
+    } else {
+        g_output_stream_close(export->stream, NULL, NULL);
+        g_object_unref(export->stream);
+    }
+    g_object_unref(export->terminal);
+    g_free(export->target);
+    g_free(export);
+}
+
+void ScrollbackChunkWritten(GObject* source, GAsyncResult* result, gpointer data);
+
+void WriteScrollbackChunk(ScrollbackExport* export) {
+    TerminalState* state = GetTerminalState(export->terminal);
+    if (state == NULL || state->closed || export->row > export->end_row) {
+        FinishScrollbackExport(export, NULL);
+        return;
+    }
+    VteTerminal* terminal = VTE_TERMINAL(export->terminal);
+    GtkAdjustment* adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(export->terminal));
+    glong first = MAX(export->row, (glong) gtk_adjustment_get_lower(adjustment));
+    glong last = MIN(first + SCROLLBACK_CHUNK_ROWS - 1, export->end_row);
+    export->row = last + 1;
+
+    gchar* text = vte_terminal_get_text_range(terminal, first, 0, last, vte_terminal_get_column_count(terminal) - 1, NULL, NULL, NULL);
+    export->chunk = text != NULL && !g_str_has_suffix(text, "\n") ? g_strconcat(text, "\n", NULL) : g_strdup(text != NULL ? text : "");
+    g_free(text);
+    g_output_stream_write_all_async(export->stream, export->chunk, strlen(export->chunk), G_PRIORITY_LOW, NULL, ScrollbackChunkWritten, export);
+}
+
+void ScrollbackChunkWritten(GObject* source, GAsyncResult* result, gpointer data) {
+    ScrollbackExport* export = data;
+    GError* error = NULL;
+    gsize written = 0;
+    gboolean success = g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result, &written, &error);
+
+    export->written += written;
+    g_free(export->chunk);
+    export->chunk = NULL;
+    if (success) {
+        WriteScrollbackChunk(export);
+    } else {
+        FinishScrollbackExport(export, error);
+        g_error_free(error);
+    }
+}
+
+void ExportScrollback(TerminalState* state, GIOStream* connection, GOutputStream* stream, const gchar* target) {
+    ScrollbackExport* export = g_new0(ScrollbackExport, 1);
+    glong column = 0;
+    export->terminal = g_object_ref(state->terminal);
+    export->connection = connection;
+    export->stream = stream;
+    export->target = g_strdup(target);
+    export->row = (glong) gtk_adjustment_get_lower(gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(state->terminal)));
+    vte_terminal_get_cursor_position(VTE_TERMINAL(state->terminal), &column, &export->end_row);
+    WriteScrollbackChunk(export);
+}
+
+void PipeScrollback(void) {
+    TerminalState* state = GetActiveTerminalState();
+    if (state == NULL) {
+        return;
+    }
+    gint input = -1;
+    OpenTab(state, CurrentSettings->pipe_command, &input);
+    if (input < 0) {
+        return;
+    }
+
+    GError* error = NULL;
+    GSocket* socket = g_socket_new_from_fd(input, &error);
+    if (socket == NULL) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return;
+    }
+    GIOStream* connection = G_IO_STREAM(g_socket_connection_factory_create_connection(socket));
+    g_object_unref(socket);
+    ExportScrollback(state, connection, g_io_stream_get_output_stream(connection), CurrentSettings->pipe_command);
+}
+
+void SaveScrollback(void) {
+    TerminalState* state = GetActiveTerminalState();
+    if (state == NULL) {
+        return;
+    }
+    GtkWidget* dialog = gtk_file_chooser_dialog_new("Save Scrollback", GTK_WINDOW(state->window), GTK_FILE_CHOOSER_ACTION_SAVE,
+                                                    "_Cancel", GTK_RESPONSE_CANCEL, "_Save", GTK_RESPONSE_ACCEPT, NULL);
+    gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(dialog), TRUE);
+    gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dialog), "scrollback.txt");
+    if (state->cwd != NULL) {
+        gtk_file_chooser_set_current_folder(GTK_FILE_CHOOSER(dialog), state->cwd);
+    }
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT && !state->closed) {
+        GFile* file = gtk_file_chooser_get_file(GTK_FILE_CHOOSER(dialog));
+        GError* error = NULL;
+        GFileOutputStream* stream = g_file_replace(file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error);
+        if (stream != NULL) {
+            gchar* path = g_file_get_parse_name(file);
+            ExportScrollback(state, NULL, G_OUTPUT_STREAM(stream), path);
+            g_free(path);
+        } else {
+            g_printerr("%s\n", error->message);
+            g_error_free(error);
+        }
+        g_object_unref(file);
+    }
+    gtk_widget_destroy(dialog);
+}
+
+void Copy(void) {
+    if (ActiveTerminal != NULL) {
+        vte_terminal_copy_clipboard_format(VTE_TERMINAL(ActiveTerminal), VTE_FORMAT_TEXT);
+    }
+}
+
+void BroadcastPaste(TerminalState* source);
+
+void Paste(void) {
+    if (ActiveTerminal != NULL) {
+        vte_terminal_paste_clipboard(VTE_TERMINAL(ActiveTerminal));
+        BroadcastPaste(GetTerminalState(ActiveTerminal));
+    }
+}
+
+void ClearScrollback(void) {
+    g_print("ClearScrollback\n");
+}
+
+void NameTab(void) {
+    TerminalState *state = GetActiveTerminalState();
+    if (state == NULL) {
+        return;
+    }
+    GtkWidget *dialog = gtk_dialog_new_with_buttons("Name Tab", GTK_WINDOW(state->window), GTK_DIALOG_MODAL, "Cancel", GTK_RESPONSE_CANCEL, "OK", GTK_RESPONSE_OK, NULL);
+
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+
+    GtkWidget *entry = gtk_entry_new();
+    gtk_entry_set_max_length(GTK_ENTRY(entry), 50);
+    gtk_entry_set_activates_default(GTK_ENTRY(entry), TRUE);
+    gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_OK);
+    gtk_widget_show(entry);
+
+    if (state->name != NULL) {
+        gtk_entry_set_text(GTK_ENTRY(entry), state->name);
+    } else {
+        gchar *directory = state->cwd != NULL ? GetDisplayDirectory(state->cwd) : NULL;
+        gchar *title_text = directory != NULL ?
+            g_strdup_printf("%s@%s:%s", g_get_user_name(), g_get_host_name(), directory) :
+            g_strdup_printf("%s@%s", g_get_user_name(), g_get_host_name());
+        gtk_entry_set_text(GTK_ENTRY(entry), title_text);
+        g_free(title_text);
+        g_free(directory);
+    }
+
+    gtk_container_add(GTK_CONTAINER(content_area), entry);
+
+    gint result = gtk_dialog_run(GTK_DIALOG(dialog));
+    if (result == GTK_RESPONSE_OK && !state->closed) {
+        const gchar *name = gtk_entry_get_text(GTK_ENTRY(entry));
+        g_free(state->name);
+        state->name = name[0] != '\0' ? g_strdup(name) : NULL;
+        UpdateTabLabel(state);
+    }
+
+    gtk_widget_destroy(dialog);
+}
+
+int NumTabs = 0;
+
+void UpdateNumTabs(GtkWidget* TabContainer) {
+    GList* children = gtk_container_get_children(GTK_CONTAINER(TabContainer));
+    NumTabs = g_list_length(children);
+    g_list_free(children);
+}
+
+gboolean ConfirmExit(GtkWidget* widget, GdkEvent* event, gpointer data) {
+    GtkWidget* TabContainer = GetWindowNotebook(widget);
+    UpdateNumTabs(TabContainer);
+    if (NumTabs <= 1 || CurrentSettings->disable_confirm) {
+        return FALSE;
+    }
+
+    gchar* message = g_strdup_printf("You are about to close %d tabs. Are you sure you want to continue?", NumTabs);
+    GtkWidget* dialog = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_QUESTION, GTK_BUTTONS_YES_NO, "%s", message);
+
+    gtk_window_set_title(GTK_WINDOW(dialog), "Confirm Close");
+    gtk_window_set_deletable(GTK_WINDOW(dialog), FALSE);
+
+    g_free(message);
+
+    gtk_window_set_icon_from_file(GTK_WINDOW(dialog), "/usr/share/icons/hicolor/48x48/apps/illumiterm.png", NULL);
+
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+    gtk_widget_destroy(dialog);
+
+    return (response == GTK_RESPONSE_NO) ? TRUE : FALSE;
+}
+
+GtkWidget* ContextMenuHelper(GtkWidget* menu, const gchar* imagePath, const gchar* labelText, GCallback callback) {
+    GtkWidget *item, *box, *icon, *label;
+    
+    item = gtk_menu_item_new();
+    box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    icon = gtk_image_new_from_file(imagePath);
+    label = gtk_label_new(labelText);
+    
+    GtkWidget* spacing = gtk_label_new("  ");
+    
+    gtk_box_pack_start(GTK_BOX(box), icon, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(box), spacing, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
+    gtk_container_add(GTK_CONTAINER(item), box);
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), item);
+    g_signal_connect(item, "activate", callback, NULL);
+
+    return item;
+}
+
+gboolean DestroyMenu(gpointer data) {
+    gtk_widget_destroy(GTK_WIDGET(data));
+    return G_SOURCE_REMOVE;
+}
+
+void DestroyMenuLater(GtkMenuShell* menu, gpointer data) {
+    g_idle_add(DestroyMenu, menu);
+}
+
+GtkWidget* ContextMenu() {
+    GtkWidget *menu = gtk_menu_new();
+    GtkWidget *separator;
+
+    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/window-new.svg", "New Window", G_CALLBACK(NewWindow));
+    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/tab-new.svg", "New Tab", G_CALLBACK(NewTab));
+
+    separator = gtk_separator_menu_item_new();
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator);
+
+    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/edit-copy.svg", "Copy", G_CALLBACK(Copy));
+    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/edit-paste.svg", "Paste", G_CALLBACK(Paste));
+
+    separator = gtk_separator_menu_item_new();
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator);
+
+    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/edit-clear.svg", "Clear Scrollback", G_CALLBACK(ClearScrollback));
+    
+    separator = gtk_separator_menu_item_new();
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator);
+    
+    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/edit.svg", "Name Tab", G_CALLBACK(NameTab));
+
+    separator = gtk_separator_menu_item_new();
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator);
+
+    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/go-previous.svg", "Previous Tab", G_CALLBACK(PreviousTab));
+    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/go-next.svg", "Next Tab", G_CALLBACK(NextTab));
+    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/go-up.svg", "Move Tab Left", G_CALLBACK(MoveTabLeft));
+    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/go-down.svg", "Move Tab Right", G_CALLBACK(MoveTabRight));
+
+    separator = gtk_separator_menu_item_new();
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator);
+
+    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/view-split-top-bottom.svg", "Split Horizontally", G_CALLBACK(SplitHorizontally));
+    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/view-split-left-right.svg", "Split Vertically", G_CALLBACK(SplitVertically));
+    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/view-close.svg", "Close Pane", G_CALLBACK(ClosePane));
+    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/window-close.svg", "Close Tab", G_CALLBACK(CloseTab));
+
+    gtk_widget_show_all(menu);
+    g_signal_connect(menu, "deactivate", G_CALLBACK(DestroyMenuLater), NULL);
+
+    return menu;
+}
+
+void CompileLinkRegexes(void) {
+    GString* chars = g_string_new(NULL);
+    for (const gchar* c = LINK_CHARS; *c != '\0'; c++) {
+        g_string_append_printf(chars, "\\%c", *c);
+    }
+    gchar* patterns[LINK_COUNT];
+    patterns[LINK_URL] = g_strdup_printf("\\b(?:(?:https?|ftp|file)://|mailto:|www\\.)[[:alnum:]%s]*[[:alnum:]/_#=+&%%~-]", chars->str);
+    patterns[LINK_FILE] = g_strdup("(?:~|\\.{1,2})?/?(?:[[:alnum:]._+-]+/)*[[:alnum:]_+-][[:alnum:]._+-]*\\.[[:alnum:]]+:[0-9]+(?::[0-9]+)?\\b");
+
+    for (gint i = 0; i < LINK_COUNT; i++) {
+        GError* error = NULL;
+        LinkRegexes[i] = vte_regex_new_for_match(patterns[i], -1, PCRE2_CASELESS | PCRE2_MULTILINE, &error);
+        if (LinkRegexes[i] == NULL) {
+            g_printerr("%s\n", error->message);
+            g_error_free(error);
+        } else {
+            vte_regex_jit(LinkRegexes[i], PCRE2_JIT_COMPLETE, NULL);
+        }
+        g_free(patterns[i]);
+    }
+    g_string_free(chars, TRUE);
+}
+
+void AddLinkMatches(TerminalState* state) {
+    VteTerminal* terminal = VTE_TERMINAL(state->terminal);
+    vte_terminal_set_allow_hyperlink(terminal, TRUE);
+    for (gint i = 0; i < LINK_COUNT; i++) {
+        state->link_tags[i] = -1;
+        if (LinkRegexes[i] != NULL) {
+            state->link_tags[i] = vte_terminal_match_add_regex(terminal, LinkRegexes[i], 0);
+            vte_terminal_match_set_cursor_name(terminal, state->link_tags[i], "pointer");
+        }
+    }
+}
+
+void HyperlinkHovered(VteTerminal* terminal, const gchar* uri, GdkRectangle* bbox, gpointer data) {
+    gtk_widget_set_tooltip_text(GTK_WIDGET(terminal), uri);
+}
+
+void OpenFileReference(TerminalState* state, const gchar* reference) {
+    gchar** parts = g_strsplit(reference, ":", 3);
+    gchar* path = g_str_has_prefix(parts[0], "~/") ? g_build_filename(g_get_home_dir(), parts[0] + 2, NULL) : g_strdup(parts[0]);
+    gchar* quoted = g_shell_quote(path);
+    gchar* command = g_strdup_printf("exec ${VISUAL:-${EDITOR:-vi}} +%s %s", parts[1], quoted);
+
+    OpenTab(state, command, NULL);
+
+    g_free(command);
+    g_free(quoted);
+    g_free(path);
+    g_strfreev(parts);
+}
+
+gboolean OpenLink(GtkWidget* widget, GdkEvent* event) {
+    TerminalState* state = GetTerminalState(widget);
+    gint tag = -1;
+    gchar* uri = vte_terminal_hyperlink_check_event(VTE_TERMINAL(widget), event);
+    gchar* match = uri == NULL ? vte_terminal_match_check_event(VTE_TERMINAL(widget), event, &tag) : NULL;
+
+    if (state == NULL || (uri == NULL && (match == NULL || tag < 0))) {
+        g_free(match);
+        return FALSE;
+    }
+    if (uri == NULL && tag == state->link_tags[LINK_FILE]) {
+        OpenFileReference(state, match);
+    } else if (uri != NULL || tag == state->link_tags[LINK_URL]) {
+        if (uri == NULL) {
+            uri = g_str_has_prefix(match, "www.") || g_str_has_prefix(match, "WWW.") ? g_strconcat("http://", match, NULL) : g_strdup(match);
+        }
+        GError* error = NULL;
+        if (!gtk_show_uri_on_window(GTK_WINDOW(state->window), uri, gdk_event_get_time(event), &error)) {
+            g_printerr("%s\n", error->message);
+            g_error_free(error);
+        }
+    } else {
+        g_free(match);
+        return FALSE;
+    }
+    g_free(uri);
+    g_free(match);
+    return TRUE;
+}
+
+gboolean ButtonPressEvent(GtkWidget *widget, GdkEventButton *event, gpointer data) {
+    if (event->button == GDK_BUTTON_PRIMARY && (event->state & GDK_CONTROL_MASK)) {
+        return OpenLink(widget, (GdkEvent *) event);
+    }
+    if (event->button != GDK_BUTTON_SECONDARY) {
+        return FALSE;
+    }
+    GtkWidget *menu = ContextMenu();
+    gtk_menu_popup_at_pointer(GTK_MENU(menu), NULL);
+
+    return TRUE;
+}
+
+void ChildReady(VteTerminal* terminal, GPid pid, GError* error, gpointer user_data) {
+    if (terminal == NULL) {
+        return;
+    }
+    TerminalState* state = GetTerminalState(GTK_WIDGET(terminal));
+    if (state != NULL) {
+        state->pid = pid;
+    }
+    if (pid == 0) {
+        GtkWidget* window = GTK_WIDGET(user_data);
+        gint error_code = (error != NULL) ? error->code : 0;
+        DestroyAndQuit(window, error_code);
+    }
+}
+
+gchar** GetEnviroment(GApplicationCommandLine* cli) {
+    const gchar* const* environment = g_application_command_line_get_environ(cli);
+
+    guint num_variables = g_strv_length((gchar**)environment);
+    gchar** result = g_new0(gchar*, num_variables + 1);
+
+    for (guint i = 0; i < num_variables; ++i) {
+        result[i] = g_strdup(environment[i]);
+    }
+    if (AccessibilityBypassed) {
+        result = g_environ_unsetenv(result, "NO_AT_BRIDGE");
+    }
+    return result;
+}
+
+KeySample* GetKeySample(TerminalState* state, guint index) {
+    return &state->latency[(state->latency_first + index) % LATENCY_PENDING];
+}
+
+void RecordLatency(KeySample* sample, gint64 now) {
+    gint64 latency = now - sample->key;
+    guint bucket = 0;
+    while (bucket < LATENCY_BUCKETS && latency > LatencyBucketLimits[bucket]) {
+        bucket++;
+    }
+    Latency.buckets[bucket]++;
+    Latency.count++;
+    Latency.to_write += sample->write - sample->key;
+    Latency.to_echo += sample->echo - sample->write;
+    Latency.to_frame += now - sample->echo;
+    Latency.max = MAX(Latency.max, latency);
+}
+
+void LatencyWritten(TerminalState* state, gint64 now, const gchar* text, gsize length) {
+    gsize offset = 0;
+    for (guint i = 0; i < state->latency_count; i++) {
+        KeySample* sample = GetKeySample(state, i);
+        if (sample->write == 0) {
+            sample->write = now;
+            sample->byte = text[MIN(offset++, length - 1)];
+        }
+    }
+}
+
+gboolean IsEchoedByte(guchar byte) {
+    return byte == '\r' || (byte >= 0x20 && byte != 0x7f);
+}
+
+void LatencyEchoed(TerminalState* state, gint64 now, const gchar* data, gsize length) {
+    gsize offset = 0;
+    for (guint i = 0; i < state->latency_count; i++) {
+        KeySample* sample = GetKeySample(state, i);
+        if (sample->write == 0 || sample->echo != 0) {
+            continue;
+        }
+        if (IsEchoedByte(sample->byte)) {
+            const gchar* echo = memchr(data + offset, sample->byte, length - offset);
+            if (echo == NULL) {
+                break;
+            }
+            offset = echo - data + 1;
+        }
+        sample->echo = now;
+    }
+}
+
+gboolean LatencyKeyPress(GtkWidget* widget, GdkEventKey* event, gpointer data) {
+    TerminalState* state = data;
+    if (event->is_modifier) {
+        return FALSE;
+    }
+    if (state->latency_count > 0 && GetKeySample(state, state->latency_count - 1)->write == 0) {
+        state->latency_count--;
+    }
+    if (state->latency_count == LATENCY_PENDING) {
+        state->latency_first = (state->latency_first + 1) % LATENCY_PENDING;
+        state->latency_count--;
+        Latency.dropped++;
+    }
+    KeySample* sample = GetKeySample(state, state->latency_count++);
+    sample->key = g_get_monotonic_time();
+    sample->write = 0;
+    sample->echo = 0;
+    return FALSE;
+}
+
+gboolean LatencyDrawn(GtkWidget* widget, cairo_t* cr, gpointer data) {
+    TerminalState* state = data;
+    gint64 now = g_get_monotonic_time();
+
+    while (state->latency_count > 0) {
+        KeySample* sample = GetKeySample(state, 0);
+        if (sample->echo != 0) {
+            RecordLatency(sample, now);
+        } else if (sample->write == 0 || now - sample->key < LATENCY_TIMEOUT) {
+            break;
+        } else {
+            Latency.dropped++;
+        }
+        state->latency_first = (state->latency_first + 1) % LATENCY_PENDING;
+        state->latency_count--;
+    }
+    return FALSE;
+}
+
+void TraceLatency(TerminalState* state, gboolean enable) {
+    if (enable && state->latency_key_handler == 0) {
+        state->latency_key_handler = g_signal_connect(state->terminal, "key-press-event", G_CALLBACK(LatencyKeyPress), state);
+        state->latency_draw_handler = g_signal_connect_after(state->terminal, "draw", G_CALLBACK(LatencyDrawn), state);
+    } else if (!enable && state->latency_key_handler != 0) {
+        g_signal_handler_disconnect(state->terminal, state->latency_key_handler);
+        g_signal_handler_disconnect(state->terminal, state->latency_draw_handler);
+        state->latency_key_handler = 0;
+        state->latency_draw_handler = 0;
+        state->latency_count = 0;
+    }
+}
+
+gint64 LatencyPercentile(guint percent) {
+    guint64 rank = (Latency.count * percent + 99) / 100;
+    guint64 seen = 0;
+    for (guint i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += Latency.buckets[i];
+        if (seen >= rank) {
+            return LatencyBucketLimits[i];
+        }
+    }
+    return Latency.max;
+}
+
+void ExportLatency(void) {
+    if (Latency.count == 0) {
+        g_print("No input latency samples recorded\n");
+        return;
+    }
+    GString* report = g_string_new("# IllumiTerm keypress-to-photon latency\n");
+    g_string_append_printf(report, "samples %" G_GUINT64_FORMAT "\n", Latency.count);
+    g_string_append_printf(report, "dropped %" G_GUINT64_FORMAT "\n", Latency.dropped);
+    g_string_append_printf(report, "key_to_write_avg_ms %.3f\n", Latency.to_write / 1000.0 / Latency.count);
+    g_string_append_printf(report, "write_to_echo_avg_ms %.3f\n", Latency.to_echo / 1000.0 / Latency.count);
+    g_string_append_printf(report, "echo_to_frame_avg_ms %.3f\n", Latency.to_frame / 1000.0 / Latency.count);
+    g_string_append_printf(report, "p50_ms %.3f\n", LatencyPercentile(50) / 1000.0);
+    g_string_append_printf(report, "p90_ms %.3f\n", LatencyPercentile(90) / 1000.0);
+    g_string_append_printf(report, "p99_ms %.3f\n", LatencyPercentile(99) / 1000.0);
+    g_string_append_printf(report, "max_ms %.3f\n", Latency.max / 1000.0);
+    g_string_append(report, "# bucket_le_ms count\n");
+    for (guint i = 0; i < LATENCY_BUCKETS; i++) {
+        g_string_append_printf(report, "%.3f %" G_GUINT64_FORMAT "\n", LatencyBucketLimits[i] / 1000.0, Latency.buckets[i]);
+    }
+    g_string_append_printf(report, "+Inf %" G_GUINT64_FORMAT "\n", Latency.buckets[LATENCY_BUCKETS]);
+
+    gchar* directory = g_build_filename(g_get_user_cache_dir(), "illumiterm", NULL);
+    gchar* name = g_strdup_printf("latency-%d.txt", getpid());
+    gchar* path = g_build_filename(directory, name, NULL);
+    GError* error = NULL;
+
+    g_mkdir_with_parents(directory, 0700);
+    if (g_file_set_contents(path, report->str, report->len, &error)) {
+        g_print("Input latency histogram written to %s\n", path);
+    } else {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+    }
+
+    g_free(directory);
+    g_free(name);
+    g_free(path);
+    g_string_free(report, TRUE);
+}
+
+void ExportLatencyAtExit(void) {
+    if (LatencyTracing) {
+        ExportLatency();
+    }
+}
+
+void SetLatencyTracing(gboolean enable) {
+    static gboolean registered = FALSE;
+    if (enable && !registered) {
+        atexit(ExportLatencyAtExit);
+        registered = TRUE;
+    }
+    LatencyTracing = enable;
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TraceLatency(l->data, enable);
+    }
+}
+
+void ToggleLatencyTracing(void) {
+    SetLatencyTracing(!LatencyTracing);
+}
+
+void MarkTab(TerminalState* state, gboolean marked) {
+    state->trigger_marked = marked;
+    if (state->tab_label != NULL) {
+        GtkStyleContext* context = gtk_widget_get_style_context(state->tab_label);
+        if (marked) {
+            gtk_style_context_add_class(context, "marked");
+        } else {
+            gtk_style_context_remove_class(context, "marked");
+        }
+    }
+    gtk_window_set_urgency_hint(GTK_WINDOW(state->window), marked && !gtk_window_is_active(GTK_WINDOW(state->window)));
+}
+
+void FireTrigger(TerminalState* state, const Trigger* trigger, const gchar* line, gsize length, gint64 now) {
+    state->trigger_hits++;
+    if ((trigger->actions & TRIGGER_MARK) && !state->trigger_marked && !gtk_widget_has_focus(state->terminal)) {
+        MarkTab(state, TRUE);
+    }
+    if ((trigger->actions & TRIGGER_NOTIFY) && now - state->trigger_notified >= TRIGGER_NOTIFY_INTERVAL) {
+        state->trigger_notified = now;
+        gchar* body = g_utf8_make_valid(line, length);
+        gchar* id = g_strdup_printf("trigger-%p", (gpointer) state);
+        GNotification* notification = g_notification_new(trigger->name);
+        g_notification_set_body(notification, body);
+        g_application_send_notification(g_application_get_default(), id, notification);
+        g_object_unref(notification);
+        g_free(id);
+        g_free(body);
+    }
+}
+
+gsize StripEscapes(const gchar* data, gsize length, gchar* plain) {
+    const guchar* bytes = (const guchar*) data;
+    gsize size = 0;
+
+    for (gsize i = 0; i < length; i++) {
+        if (bytes[i] == '\033' && i + 1 < length) {
+            i++;
+            if (bytes[i] == '[') {
+                while (i + 1 < length && (bytes[i + 1] < 0x40 || bytes[i + 1] > 0x7e)) {
+                    i++;
+                }
+                i++;
+            } else if (bytes[i] == ']') {
+                while (i + 1 < length && bytes[i + 1] != '\a' && bytes[i + 1] != '\033') {
+                    i++;
+                }
+                i += i + 2 < length && bytes[i + 1] == '\033' ? 2 : 1;
+            }
+        } else if (bytes[i] >= 0x20 || bytes[i] == '\t') {
+            plain[size++] = bytes[i];
+        }
+    }
+    return size;
+}
+
+void MatchTriggerLine(TerminalState* state, const Settings* settings, const gchar* line, gsize length, gint64 now) {
+    gchar plain[TRIGGER_LINE_LIMIT + 1];
+    gsize size = StripEscapes(line, length, plain);
+    GPtrArray* triggers = settings->triggers;
+    if (size == 0) {
+        return;
+    }
+    plain[size] = '\0';
+
+    if (settings->trigger_literals != NULL && !g_regex_match_full(settings->trigger_literals, plain, size, 0, 0, NULL, NULL)) {
+        return;
+    }
+
+    GMatchInfo* info = NULL;
+    guint8* fired = g_newa(guint8, triggers->len / 8 + 1);
+    memset(fired, 0, triggers->len / 8 + 1);
+    g_regex_match_full(settings->trigger_regex, plain, size, 0, 0, &info, NULL);
+    while (g_match_info_matches(info)) {
+        for (guint i = 0; i < triggers->len; i++) {
+            Trigger* trigger = g_ptr_array_index(triggers, i);
+            gint start = -1, end = -1;
+            if (g_match_info_fetch_pos(info, trigger->group, &start, &end) && start >= 0) {
+                if (!(fired[i / 8] & (1 << i % 8))) {
+                    FireTrigger(state, trigger, plain, size, now);
+                    fired[i / 8] |= 1 << i % 8;
+                }
+                break;
+            }
+        }
+        g_match_info_next(info, NULL);
+    }
+    g_match_info_free(info);
+}
+
+gboolean ProcessTriggers(gpointer data) {
+    const Settings* settings = CurrentSettings;
+    gint64 now = g_get_monotonic_time();
+    gint64 wait = 0;
+    gboolean busy = FALSE;
+    TriggerSource = 0;
+
+    for (GList* item = Terminals; item != NULL; item = item->next) {
+        TerminalState* state = item->data;
+        GByteArray* input = state->trigger_input;
+        if (input->len == 0) {
+            continue;
+        }
+        if (settings->trigger_regex == NULL) {
+            g_byte_array_set_size(input, 0);
+            continue;
+        }
+        if (now - state->trigger_window >= G_USEC_PER_SEC) {
+            state->trigger_window = now;
+            state->trigger_used = 0;
+        }
+        if (state->trigger_used >= TRIGGER_BUDGET) {
+            gint64 remaining = state->trigger_window + G_USEC_PER_SEC - now;
+            wait = wait == 0 ? remaining : MIN(wait, remaining);
+            continue;
+        }
+
+        gint64 started = g_get_monotonic_time();
+        gint64 deadline = started + MIN(TRIGGER_SLICE, TRIGGER_BUDGET - state->trigger_used);
+        gint64 current = started;
+        gsize offset = 0;
+
+        while (offset < input->len && current < deadline) {
+            const gchar* line = (const gchar*) input->data + offset;
+            gsize available = input->len - offset;
+            const gchar* newline = memchr(line, '\n', MIN(available, TRIGGER_LINE_LIMIT));
+            if (newline == NULL && available < TRIGGER_LINE_LIMIT) {
+                break;
+            }
+            gsize length = newline != NULL ? (gsize) (newline - line) : TRIGGER_LINE_LIMIT;
+            MatchTriggerLine(state, settings, line, length, current);
+            offset += newline != NULL ? length + 1 : length;
+            current = g_get_monotonic_time();
+        }
+        g_byte_array_remove_range(input, 0, offset);
+        state->trigger_used += current - started;
+        if (current >= deadline && input->len > 0) {
+            busy = TRUE;
+        }
+    }
+
+    if (busy) {
+        TriggerSource = g_idle_add_full(G_PRIORITY_LOW, ProcessTriggers, NULL, NULL);
+    } else if (wait > 0) {
+        TriggerSource = g_timeout_add_full(G_PRIORITY_LOW, wait / 1000 + 1, ProcessTriggers, NULL, NULL);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void QueueTriggerInput(TerminalState* state, const gchar* data, gsize length) {
+    if (state->trigger_input->len + length > TRIGGER_INPUT_LIMIT) {
+        state->trigger_skipped += length;
+        if (state->trigger_input->len > 0 && state->trigger_input->data[state->trigger_input->len - 1] != '\n') {
+            g_byte_array_append(state->trigger_input, (const guint8*) "\n", 1);
+        }
+        return;
+    }
+    g_byte_array_append(state->trigger_input, (const guint8*) data, length);
+    if (TriggerSource == 0) {
+        TriggerSource = g_idle_add_full(G_PRIORITY_LOW, ProcessTriggers, NULL, NULL);
+    }
+}
+
+GtkAdjustment* GetScrollAdjustment(TerminalState* state) {
+    return gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(state->terminal));
+}
+
+guint FindPromptMark(GArray* prompts, glong row) {
+    guint low = 0, high = prompts->len;
+    while (low < high) {
+        guint middle = low + (high - low) / 2;
+        if (g_array_index(prompts, PromptMark, middle).row < row) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+void PrunePromptMarks(TerminalState* state) {
+    guint count = FindPromptMark(state->prompts, (glong) gtk_adjustment_get_lower(GetScrollAdjustment(state)));
+    if (count > 0) {
+        g_array_remove_range(state->prompts, 0, count);
+    }
+}
+
+void RefreshCommandPanel(void) {
+    if (CommandPanel == NULL) {
+        return;
+    }
+    gtk_list_store_clear(CommandStore);
+    if (CommandPanelTerminal == NULL) {
+        return;
+    }
+    PrunePromptMarks(CommandPanelTerminal);
+
+    GArray* prompts = CommandPanelTerminal->prompts;
+    for (guint i = 0; i < prompts->len; i++) {
+        PromptMark* mark = &g_array_index(prompts, PromptMark, i);
+        gchar* status = mark->end_row < 0 ? g_strdup("") :
+                        mark->exit_status < 0 ? g_strdup("?") : g_strdup_printf("%d", mark->exit_status);
+        gchar* duration = mark->output_row < 0 ? g_strdup("") :
+                          mark->end_row < 0 ? g_strdup("running") :
+                          g_strdup_printf("%.3f s", (mark->finished - mark->started) / (gdouble) G_USEC_PER_SEC);
+        GtkTreeIter iter;
+
+        gtk_list_store_append(CommandStore, &iter);
+        gtk_list_store_set(CommandStore, &iter,
+            COMMAND_COLUMN_COMMAND, mark->command != NULL ? mark->command : "",
+            COMMAND_COLUMN_STATUS, status,
+            COMMAND_COLUMN_DURATION, duration,
+            COMMAND_COLUMN_ROW, mark->row,
+            -1);
+
+        g_free(status);
+        g_free(duration);
+    }
+}
+
+void HandlePromptMark(TerminalState* state, const gchar* params) {
+    VteTerminal* terminal = VTE_TERMINAL(state->terminal);
+    GArray* prompts = state->prompts;
+    PromptMark* last = prompts->len > 0 ? &g_array_index(prompts, PromptMark, prompts->len - 1) : NULL;
+    glong column, row;
+    vte_terminal_get_cursor_position(terminal, &column, &row);
+
+    if (params[0] == 'A') {
+        if (last != NULL && row < last->row) {
+            g_array_set_size(prompts, 0);
+        } else if (last != NULL && row == last->row) {
+            return;
+        }
+        PrunePromptMarks(state);
+        PromptMark mark = {row, -1, 0, -1, -1, 0, 0, 0, -1, NULL};
+        g_array_append_val(prompts, mark);
+    } else if (last == NULL) {
+        return;
+    } else if (params[0] == 'B') {
+        last->command_row = row;
+        last->command_column = column;
+    } else if (params[0] == 'C' && last->output_row < 0) {
+        last->output_row = row;
+        last->started = g_get_monotonic_time();
+        if (last->command_row >= 0) {
+            gchar* text = vte_terminal_get_text_range(terminal, last->command_row, last->command_column, row, column, NULL, NULL, NULL);
+            last->command = text != NULL ? g_strstrip(text) : NULL;
+        }
+    } else if (params[0] == 'D' && last->output_row >= 0 && last->end_row < 0) {
+        last->end_row = row;
+        last->end_column = column;
+        last->finished = g_get_monotonic_time();
+        last->exit_status = params[1] == ';' ? atoi(params + 2) : -1;
+        if (CommandPanelTerminal == state) {
+            RefreshCommandPanel();
+        }
+    }
+}
+
+gsize FeedTerminal(TerminalState* state, const gchar* data, gsize length) {
+    static const gchar prefix[] = "\033]133;";
+    const gchar* start = data;
+    const gchar* end = data + length;
+    const gchar* p = data;
+
+    while (p < end) {
+        if (state->osc_match == 0) {
+            p = memchr(p, '\033', end - p);
+            if (p == NULL) {
+                break;
+            }
+        }
+        gchar c = *p++;
+        gboolean complete = FALSE;
+
+        if (state->osc_match < sizeof(prefix) - 1) {
+            state->osc_match = c == prefix[state->osc_match] ? state->osc_match + 1 : c == '\033';
+        } else if (state->osc_match == sizeof(prefix) - 1) {
+            if (c == '\a') {
+                complete = TRUE;
+            } else if (c == '\033') {
+                state->osc_match++;
+            } else if (state->osc_length < OSC_BUFFER_SIZE - 1) {
+                state->osc[state->osc_length++] = c;
+            }
+        } else if (c == '\\') {
+            complete = TRUE;
+        } else {
+            state->osc_match = c == '\033';
+            state->osc_length = 0;
+        }
+
+        if (complete) {
+            gsize sequence = sizeof(prefix) - 1 + state->osc_length + (c == '\a' ? 1 : 2);
+            state->fed_unprocessed = state->fed_unprocessed || (gsize) (p - start) > sequence;
+            vte_terminal_feed(VTE_TERMINAL(state->terminal), start, p - start);
+            start = p;
+            state->osc[state->osc_length] = '\0';
+            state->osc_match = 0;
+            state->osc_length = 0;
+            if (state->fed_unprocessed) {
+                g_strlcpy(state->mark, state->osc, sizeof(state->mark));
+                state->mark_pending = TRUE;
+                return p - data;
+            }
+            HandlePromptMark(state, state->osc);
+        }
+    }
+    if (start < end) {
+        vte_terminal_feed(VTE_TERMINAL(state->terminal), start, end - start);
+        state->fed_unprocessed = TRUE;
+    }
+    return length;
+}
+
+void ScrollToRow(TerminalState* state, glong row) {
+    GtkAdjustment* adjustment = GetScrollAdjustment(state);
+    gdouble last = gtk_adjustment_get_upper(adjustment) - gtk_adjustment_get_page_size(adjustment);
+    gtk_adjustment_set_value(adjustment, CLAMP(row, gtk_adjustment_get_lower(adjustment), last));
+}
+
+void PreviousPrompt(void) {
+    TerminalState* state = GetActiveTerminalState();
+    if (state == NULL) {
+        return;
+    }
+    PrunePromptMarks(state);
+    guint index = FindPromptMark(state->prompts, (glong) gtk_adjustment_get_value(GetScrollAdjustment(state)));
+    if (index > 0) {
+        ScrollToRow(state, g_array_index(state->prompts, PromptMark, index - 1).row);
+    }
+}
+
+void NextPrompt(void) {
+    TerminalState* state = GetActiveTerminalState();
+    if (state == NULL) {
+        return;
+    }
+    PrunePromptMarks(state);
+    guint index = FindPromptMark(state->prompts, (glong) gtk_adjustment_get_value(GetScrollAdjustment(state)) + 1);
+    if (index < state->prompts->len) {
+        ScrollToRow(state, g_array_index(state->prompts, PromptMark, index).row);
+    }
+}
+
+PromptMark* GetViewedCommand(TerminalState* state) {
+    GtkAdjustment* adjustment = GetScrollAdjustment(state);
+    GArray* prompts = state->prompts;
+    gdouble top = gtk_adjustment_get_value(adjustment);
+
+    PrunePromptMarks(state);
+    if (top + gtk_adjustment_get_page_size(adjustment) >= gtk_adjustment_get_upper(adjustment)) {
+        for (guint i = prompts->len; i > 0; i--) {
+            if (g_array_index(prompts, PromptMark, i - 1).end_row >= 0) {
+                return &g_array_index(prompts, PromptMark, i - 1);
+            }
+        }
+        return NULL;
+    }
+    guint index = FindPromptMark(prompts, (glong) top + 1);
+    return index > 0 ? &g_array_index(prompts, PromptMark, index - 1) : NULL;
+}
+
+void CopyCommandOutput(void) {
+    TerminalState* state = GetActiveTerminalState();
+    PromptMark* mark = state != NULL ? GetViewedCommand(state) : NULL;
+    if (mark == NULL || mark->output_row < 0) {
+        return;
+    }
+    VteTerminal* terminal = VTE_TERMINAL(state->terminal);
+    glong first = MAX(mark->output_row, (glong) gtk_adjustment_get_lower(GetScrollAdjustment(state)));
+    glong end_row = mark->end_row, end_column = mark->end_column;
+    if (end_row < 0) {
+        vte_terminal_get_cursor_position(terminal, &end_column, &end_row);
+    }
+    if (end_column > 0) {
+        end_column--;
+    } else {
+        end_row--;
+        end_column = vte_terminal_get_column_count(terminal) - 1;
+    }
+    if (end_row < first) {
+        return;
+    }
+
+    gchar* text = vte_terminal_get_text_range(terminal, first, 0, end_row, end_column, NULL, NULL, NULL);
+    if (text != NULL) {
+        gtk_clipboard_set_text(gtk_clipboard_get(GDK_SELECTION_CLIPBOARD), text, -1);
+        g_free(text);
+    }
+}
+
+void CommandActivated(GtkTreeView* tree_view, GtkTreePath* path, GtkTreeViewColumn* column, gpointer data) {
+    GtkTreeIter iter;
+    glong row;
+    if (CommandPanelTerminal == NULL || !gtk_tree_model_get_iter(GTK_TREE_MODEL(CommandStore), &iter, path)) {
+        return;
+    }
+    gtk_tree_model_get(GTK_TREE_MODEL(CommandStore), &iter, COMMAND_COLUMN_ROW, &row, -1);
+    ScrollToRow(CommandPanelTerminal, row);
+    gtk_window_present(GTK_WINDOW(CommandPanelTerminal->window));
+}
+
+void CommandPanelDestroyed(GtkWidget* widget, gpointer data) {
+    CommandPanel = NULL;
+    CommandPanelTerminal = NULL;
+}
+
+void CommandHistory(void) {
+    CommandPanelTerminal = GetActiveTerminalState();
+    if (CommandPanel != NULL) {
+        RefreshCommandPanel();
+        gtk_window_present(GTK_WINDOW(CommandPanel));
+        return;
+    }
+
+    CommandPanel = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(CommandPanel), "Command History");
+    gtk_window_set_default_size(GTK_WINDOW(CommandPanel), 640, 300);
+    gtk_window_set_icon_from_file(GTK_WINDOW(CommandPanel), "/usr/share/icons/hicolor/48x48/apps/illumiterm.png", NULL);
+    g_signal_connect(CommandPanel, "destroy", G_CALLBACK(CommandPanelDestroyed), NULL);
+
+    CommandStore = gtk_list_store_new(COMMAND_NUM_COLUMNS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_LONG);
+    GtkWidget* tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(CommandStore));
+    g_object_unref(CommandStore);
+    g_signal_connect(tree_view, "row-activated", G_CALLBACK(CommandActivated), NULL);
+
+    const gchar* titles[] = {"Command", "Exit", "Duration"};
+    for (int i = 0; i < G_N_ELEMENTS(titles); i++) {
+        gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(tree_view), -1, titles[i], gtk_cell_renderer_text_new(), "text", i, NULL);
+    }
+
+    GtkWidget* scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), tree_view);
+    gtk_container_add(GTK_CONTAINER(CommandPanel), scrolled_window);
+
+    RefreshCommandPanel();
+    gtk_widget_show_all(CommandPanel);
+}
+
+void FreeArchiveMatch(gpointer data) {
+    ArchiveMatch* match = data;
+    g_free(match->text);
+    g_free(match);
+}
+
+void FreeArchiveSearch(gpointer data) {
+    ArchiveSearch* search = data;
+    g_atomic_rc_box_release_full(search->archive, ClearArchive);
+    g_regex_unref(search->regex);
+    g_free(search);
+}
+
+void SearchArchiveThread(GTask* task, gpointer source, gpointer data, GCancellable* cancellable) {
+    ArchiveSearch* search = data;
+    ScrollbackArchive* archive = search->archive;
+    GPtrArray* matches = g_ptr_array_new_with_free_func(FreeArchiveMatch);
+
+    g_mutex_lock(&archive->lock);
+    GArray* blocks = g_array_copy(archive->blocks);
+    g_mutex_unlock(&archive->lock);
+
+    for (guint i = 0; i < blocks->len && matches->len < SEARCH_RESULT_LIMIT && !g_cancellable_is_cancelled(cancellable); i++) {
+        ArchiveBlock* block = &g_array_index(blocks, ArchiveBlock, i);
+        if (block->first_row >= search->live_row) {
+            break;
+        }
+        GError* error = NULL;
+        gchar* text = ReadArchiveBlock(archive, block, &error);
+        if (text == NULL) {
+            g_task_return_error(task, error);
+            g_array_unref(blocks);
+            g_ptr_array_unref(matches);
+            return;
+        }
+        guint64 line = block->first_line;
+        for (gchar* start = text; start != NULL && *start != '\0' && matches->len < SEARCH_RESULT_LIMIT; line++) {
+            gchar* end = strchr(start, '\n');
+            if (end != NULL) {
+                *end = '\0';
+            }
+            if (g_regex_match(search->regex, start, 0, NULL)) {
+                ArchiveMatch* match = g_new(ArchiveMatch, 1);
+                match->line = line;
+                match->text = g_strdup(start);
+                g_ptr_array_add(matches, match);
+            }
+            start = end != NULL ? end + 1 : NULL;
+        }
+        g_free(text);
+    }
+    g_array_unref(blocks);
+    g_task_return_pointer(task, matches, (GDestroyNotify) g_ptr_array_unref);
+}
+
+void ArchiveSearched(GObject* source, GAsyncResult* result, gpointer data) {
+    GError* error = NULL;
+    GPtrArray* matches = g_task_propagate_pointer(G_TASK(result), &error);
+    if (matches == NULL) {
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_printerr("%s\n", error->message);
+        }
+        g_error_free(error);
+        return;
+    }
+    if (SearchPanel != NULL) {
+        for (guint i = 0; i < matches->len; i++) {
+            ArchiveMatch* match = g_ptr_array_index(matches, i);
+            gchar* where = g_strdup_printf("Archive line %" G_GUINT64_FORMAT, match->line + 1);
+            GtkTreeIter iter;
+            gtk_list_store_insert_with_values(SearchStore, &iter, i,
+                SEARCH_COLUMN_WHERE, where,
+                SEARCH_COLUMN_TEXT, match->text,
+                SEARCH_COLUMN_ROW, (glong) -1,
+                -1);
+            g_free(where);
+        }
+    }
+    g_ptr_array_unref(matches);
+}
+
+gboolean SearchLiveRows(gpointer data) {
+    VteTerminal* terminal = VTE_TERMINAL(SearchTerminal->terminal);
+    gint64 deadline = g_get_monotonic_time() + SEARCH_SLICE_TIME;
+    while (SearchRow <= SearchLastRow && SearchFound < SEARCH_RESULT_LIMIT && g_get_monotonic_time() < deadline) {
+        gchar* text = vte_terminal_get_text_range(terminal, SearchRow, 0, SearchRow, vte_terminal_get_column_count(terminal) - 1, NULL, NULL, NULL);
+        if (text != NULL && g_regex_match(SearchRegex, g_strchomp(text), 0, NULL)) {
+            gchar* where = g_strdup_printf("Row %ld", SearchRow - SearchLiveRow + 1);
+            GtkTreeIter iter;
+            gtk_list_store_insert_with_values(SearchStore, &iter, -1,
+                SEARCH_COLUMN_WHERE, where,
+                SEARCH_COLUMN_TEXT, text,
+                SEARCH_COLUMN_ROW, SearchRow,
+                -1);
+            g_free(where);
+            SearchFound++;
+        }
+        g_free(text);
+        SearchRow++;
+    }
+    if (SearchRow <= SearchLastRow && SearchFound < SEARCH_RESULT_LIMIT) {
+        return G_SOURCE_CONTINUE;
+    }
+    SearchSource = 0;
+    g_clear_pointer(&SearchRegex, g_regex_unref);
+    return G_SOURCE_REMOVE;
+}
+
+void RunSearch(GtkEntry* entry, gpointer data) {
+    StopSearch();
+    gtk_list_store_clear(SearchStore);
+    const gchar* pattern = gtk_entry_get_text(entry);
+    if (SearchTerminal == NULL || *pattern == '\0') {
+        return;
+    }
+
+    GError* error = NULL;
+    GRegex* regex = g_regex_new(pattern, G_REGEX_CASELESS | G_REGEX_OPTIMIZE, 0, &error);
+    gtk_widget_set_tooltip_text(GTK_WIDGET(entry), error != NULL ? error->message : NULL);
+    if (regex == NULL) {
+        g_error_free(error);
+        return;
+    }
+
+    glong column = 0;
+    SearchLiveRow = (glong) gtk_adjustment_get_lower(GetScrollAdjustment(SearchTerminal));
+    if (SearchTerminal->archive != NULL) {
+        SearchLiveRow = MAX(SearchLiveRow, SearchTerminal->archive->pending_row);
+    }
+    vte_terminal_get_cursor_position(VTE_TERMINAL(SearchTerminal->terminal), &column, &SearchLastRow);
+    SearchRow = SearchLiveRow;
+    SearchFound = 0;
+    SearchRegex = g_regex_ref(regex);
+    SearchSource = g_idle_add(SearchLiveRows, NULL);
+
+    if (SearchTerminal->archive != NULL) {
+        ArchiveSearch* search = g_new0(ArchiveSearch, 1);
+        search->archive = g_atomic_rc_box_acquire(SearchTerminal->archive);
+        search->regex = g_regex_ref(regex);
+        search->live_row = SearchLiveRow;
+        SearchCancellable = g_cancellable_new();
+        GTask* task = g_task_new(NULL, SearchCancellable, ArchiveSearched, NULL);
+        g_task_set_task_data(task, search, FreeArchiveSearch);
+        g_task_run_in_thread(task, SearchArchiveThread);
+        g_object_unref(task);
+    }
+    g_regex_unref(regex);
+}
+
+void SearchActivated(GtkTreeView* tree_view, GtkTreePath* path, GtkTreeViewColumn* column, gpointer data) {
+    GtkTreeIter iter;
+    glong row;
+    if (SearchTerminal == NULL || !gtk_tree_model_get_iter(GTK_TREE_MODEL(SearchStore), &iter, path)) {
+        return;
+    }
+    gtk_tree_model_get(GTK_TREE_MODEL(SearchStore), &iter, SEARCH_COLUMN_ROW, &row, -1);
+    if (row >= 0) {
+        ScrollToRow(SearchTerminal, row);
+        gtk_window_present(GTK_WINDOW(SearchTerminal->window));
+    }
+}
+
+void SearchPanelDestroyed(GtkWidget* widget, gpointer data) {
+    StopSearch();
+    SearchPanel = NULL;
+    SearchTerminal = NULL;
+}
+
+void SearchScrollback(void) {
+    SearchTerminal = GetActiveTerminalState();
+    if (SearchPanel != NULL) {
+        StopSearch();
+        gtk_list_store_clear(SearchStore);
+        gtk_window_present(GTK_WINDOW(SearchPanel));
+        return;
+    }
+
+    SearchPanel = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(SearchPanel), "Search Scrollback");
+    gtk_window_set_default_size(GTK_WINDOW(SearchPanel), 640, 300);
+    gtk_window_set_icon_from_file(GTK_WINDOW(SearchPanel), "/usr/share/icons/hicolor/48x48/apps/illumiterm.png", NULL);
+    g_signal_connect(SearchPanel, "destroy", G_CALLBACK(SearchPanelDestroyed), NULL);
+
+    GtkWidget* entry = gtk_search_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(entry), "Regular expression, including archived history");
+    g_signal_connect(entry, "activate", G_CALLBACK(RunSearch), NULL);
+
+    SearchStore = gtk_list_store_new(SEARCH_NUM_COLUMNS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_LONG);
+    GtkWidget* tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(SearchStore));
+    g_object_unref(SearchStore);
+    g_signal_connect(tree_view, "row-activated", G_CALLBACK(SearchActivated), NULL);
+
+    const gchar* titles[] = {"Where", "Text"};
+    for (int i = 0; i < G_N_ELEMENTS(titles); i++) {
+        gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(tree_view), -1, titles[i], gtk_cell_renderer_text_new(), "text", i, NULL);
+    }
+
+    GtkWidget* scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), tree_view);
+    GtkWidget* vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), entry, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), scrolled_window, TRUE, TRUE, 0);
+    gtk_container_add(GTK_CONTAINER(SearchPanel), vbox);
+
+    gtk_widget_show_all(SearchPanel);
+}
+
+void ExportArchive(void) {
+    TerminalState* state = GetActiveTerminalState();
+    if (state == NULL || state->archive == NULL) {
+        return;
+    }
+    GtkWidget* dialog = gtk_file_chooser_dialog_new("Export Scrollback Archive", GTK_WINDOW(state->window), GTK_FILE_CHOOSER_ACTION_SAVE,
+                                                    "_Cancel", GTK_RESPONSE_CANCEL, "_Save", GTK_RESPONSE_ACCEPT, NULL);
+    gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(dialog), TRUE);
+    gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dialog), "scrollback.gz");
+    if (state->cwd != NULL) {
+        gtk_file_chooser_set_current_folder(GTK_FILE_CHOOSER(dialog), state->cwd);
+    }
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT && !state->closed && state->archive != NULL) {
+        FlushArchive(state->archive);
+        QueueArchiveJob(state->archive, NULL, 0, gtk_file_chooser_get_file(GTK_FILE_CHOOSER(dialog)));
+    }
+    gtk_widget_destroy(dialog);
+}
+
+gboolean PtyWritable(gint fd, GIOCondition condition, gpointer data) {
+    TerminalState* state = data;
+    gssize written = write(fd, state->output->data, state->output->len);
+
+    if (written < 0 && errno != EAGAIN && errno != EINTR) {
+        g_byte_array_set_size(state->output, 0);
+    } else if (written > 0) {
+        state->bytes_out += written;
+        atomic_fetch_add_explicit(&MetricBytesOut, written, memory_order_relaxed);
+        g_byte_array_remove_range(state->output, 0, written);
+    }
+    if (state->output->len > 0) {
+        return G_SOURCE_CONTINUE;
+    }
+    state->write_source = 0;
+    return G_SOURCE_REMOVE;
+}
+
+void PtyWrite(TerminalState* state, const gchar* text, gsize length) {
+    if (state->pty == NULL || length == 0) {
+        return;
+    }
+    gint fd = vte_pty_get_fd(state->pty);
+
+    if (state->latency_count > 0) {
+        LatencyWritten(state, g_get_monotonic_time(), text, length);
+    }
+
+    if (state->output->len == 0) {
+        gssize written = write(fd, text, length);
+        if (written < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                return;
+            }
+            written = 0;
+        }
+        state->bytes_out += written;
+        atomic_fetch_add_explicit(&MetricBytesOut, written, memory_order_relaxed);
+        text += written;
+        length -= written;
+    }
+    if (length > 0) {
+        g_byte_array_append(state->output, (const guint8*) text, length);
+        if (state->write_source == 0) {
+            state->write_source = g_unix_fd_add(fd, G_IO_OUT, PtyWritable, state);
+        }
+    }
+}
+
+void RenderThumbnail(TerminalState* state) {
+    VteTerminal* terminal = VTE_TERMINAL(state->terminal);
+    glong rows = vte_terminal_get_row_count(terminal);
+    glong columns = MAX(vte_terminal_get_column_count(terminal), 1);
+    gdouble aspect = rows * vte_terminal_get_char_height(terminal) / (gdouble) MAX(columns * vte_terminal_get_char_width(terminal), 1);
+    gint height = CLAMP((gint) (THUMBNAIL_WIDTH * aspect), 1, THUMBNAIL_MAX_HEIGHT);
+
+    if (state->thumbnail == NULL || cairo_image_surface_get_height(state->thumbnail) != height) {
+        DropThumbnail(state);
+        state->thumbnail = cairo_image_surface_create(CAIRO_FORMAT_RGB24, THUMBNAIL_WIDTH, height);
+        ThumbnailBytes += cairo_image_surface_get_stride(state->thumbnail) * height;
+        ThumbnailCount++;
+    }
+
+    GtkAdjustment* adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(state->terminal));
+    glong top = (glong) gtk_adjustment_get_value(adjustment);
+    gchar* text = vte_terminal_get_text_range(terminal, top, 0, top + rows - 1, columns - 1, NULL, NULL, NULL);
+
+    cairo_t* cr = cairo_create(state->thumbnail);
+    gdk_cairo_set_source_rgba(cr, &CurrentSettings->background);
+    cairo_paint(cr);
+    PangoLayout* layout = pango_cairo_create_layout(cr);
+    PangoFontDescription* font = pango_font_description_from_string("Monospace");
+    pango_font_description_set_absolute_size(font, MAX(THUMBNAIL_WIDTH / 0.6 / columns, 1.0) * PANGO_SCALE);
+    pango_layout_set_font_description(layout, font);
+    pango_layout_set_text(layout, text != NULL ? text : "", -1);
+    gdk_cairo_set_source_rgba(cr, &CurrentSettings->foreground);
+    pango_cairo_show_layout(cr, layout);
+    pango_font_description_free(font);
+    g_object_unref(layout);
+    cairo_destroy(cr);
+    g_free(text);
+
+    state->thumbnail_dirty = FALSE;
+    state->thumbnail_at = g_get_monotonic_time();
+    if (state->overview_item != NULL) {
+        gtk_image_set_from_surface(GTK_IMAGE(g_object_get_data(G_OBJECT(state->overview_item), "image")), state->thumbnail);
+    }
+}
+
+void LimitThumbnails(void) {
+    while (ThumbnailBytes > THUMBNAIL_MEMORY_LIMIT) {
+        TerminalState* oldest = NULL;
+        for (GList* l = Terminals; l != NULL; l = l->next) {
+            TerminalState* state = l->data;
+            if (state->thumbnail != NULL && (oldest == NULL || state->thumbnail_at < oldest->thumbnail_at)) {
+                oldest = state;
+            }
+        }
+        DropThumbnail(oldest);
+    }
+}
+
+void ScheduleThumbnails(void);
+
+gboolean RefreshThumbnails(gpointer data) {
+    gint64 started = g_get_monotonic_time();
+    gboolean pending = FALSE;
+    ThumbnailSource = 0;
+
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        if (!state->thumbnail_dirty || (state->thumbnail == NULL && ThumbnailBytes >= THUMBNAIL_MEMORY_LIMIT)) {
+            continue;
+        }
+        if (g_get_monotonic_time() - started > THUMBNAIL_SLICE) {
+            pending = TRUE;
+            break;
+        }
+        RenderThumbnail(state);
+    }
+    LimitThumbnails();
+    if (pending) {
+        ScheduleThumbnails();
+    }
+    return G_SOURCE_REMOVE;
+}
 
-const gchar* GetNewWindowTitle(VteTerminal* terminal) {
-    return vte_terminal_get_window_title(terminal);
+void ScheduleThumbnails(void) {
+    if (ThumbnailSource == 0) {
+        ThumbnailSource = g_timeout_add_full(G_PRIORITY_LOW, THUMBNAIL_REFRESH_INTERVAL, RefreshThumbnails, NULL, NULL);
+    }
 }
 
-void SetWindowTitle(GtkWidget* window, const gchar* newTitle) {
-    gtk_window_set_title(GTK_WINDOW(window), newTitle);
+void InvalidateThumbnail(TerminalState* state) {
+    state->thumbnail_dirty = TRUE;
+    ScheduleThumbnails();
 }
 
-void WindowTitleChanged(GtkWidget* widget, gpointer window) {
-    const gchar* new_title = GetNewWindowTitle(VTE_TERMINAL(widget));
-    SetWindowTitle(GTK_WIDGET(window), new_title);
+void OverviewItemClicked(GtkButton* button, gpointer data) {
+    TerminalState* state = GetTerminalState(GTK_WIDGET(data));
+    GtkNotebook* notebook = GTK_NOTEBOOK(GetWindowNotebook(state->window));
+    gtk_notebook_set_current_page(notebook, gtk_notebook_page_num(notebook, state->page));
+    gtk_window_present(GTK_WINDOW(state->window));
+    gtk_widget_grab_focus(state->terminal);
+    gtk_widget_destroy(Overview);
 }
 
-void SetExitStatus(GApplicationCommandLine* cli, gint status) {
-    if (cli != NULL) {
-        g_application_command_line_set_exit_status(cli, status);
-        g_object_unref(cli);
+gboolean OverviewKeyPressed(GtkWidget* widget, GdkEventKey* event, gpointer data) {
+    if (event->keyval == GDK_KEY_Escape) {
+        gtk_widget_destroy(widget);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+void OverviewClosed(GtkWidget* widget, gpointer data) {
+    Overview = NULL;
+    if (OverviewSource != 0) {
+        g_source_remove(OverviewSource);
+        OverviewSource = 0;
+    }
+}
+
+gboolean FillOverview(gpointer data) {
+    gint64 started = g_get_monotonic_time();
+    for (GList* l = Terminals; l != NULL && ThumbnailBytes + THUMBNAIL_WIDTH * 4 * THUMBNAIL_MAX_HEIGHT <= THUMBNAIL_MEMORY_LIMIT; l = l->next) {
+        TerminalState* state = l->data;
+        if (state->thumbnail != NULL || state->overview_item == NULL) {
+            continue;
+        }
+        if (g_get_monotonic_time() - started > THUMBNAIL_SLICE) {
+            return G_SOURCE_CONTINUE;
+        }
+        RenderThumbnail(state);
+    }
+    OverviewSource = 0;
+    return G_SOURCE_REMOVE;
+}
+
+void TabOverview(void) {
+    if (WindowsSpread("Tab Overview")) {
+        return;
+    }
+    if (Overview != NULL) {
+        gtk_window_present(GTK_WINDOW(Overview));
+        return;
+    }
+
+    Overview = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(Overview), "Tab Overview");
+    gtk_window_set_default_size(GTK_WINDOW(Overview), 800, 600);
+    gtk_window_set_icon_from_file(GTK_WINDOW(Overview), "/usr/share/icons/hicolor/48x48/apps/illumiterm.png", NULL);
+    g_signal_connect(Overview, "destroy", G_CALLBACK(OverviewClosed), NULL);
+    g_signal_connect(Overview, "key-press-event", G_CALLBACK(OverviewKeyPressed), NULL);
+
+    GtkWidget* flow_box = gtk_flow_box_new();
+    gtk_flow_box_set_selection_mode(GTK_FLOW_BOX(flow_box), GTK_SELECTION_NONE);
+    gtk_flow_box_set_homogeneous(GTK_FLOW_BOX(flow_box), TRUE);
+
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        GtkWidget* image = gtk_image_new_from_surface(state->thumbnail);
+        gtk_widget_set_size_request(image, THUMBNAIL_WIDTH, -1);
+        GtkWidget* label = gtk_label_new(gtk_label_get_text(GTK_LABEL(state->tab_label)));
+        gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_END);
+        gtk_label_set_max_width_chars(GTK_LABEL(label), 30);
+
+        GtkWidget* box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
+        gtk_box_pack_start(GTK_BOX(box), image, FALSE, FALSE, 0);
+        gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
+
+        state->overview_item = gtk_button_new();
+        gtk_container_add(GTK_CONTAINER(state->overview_item), box);
+        g_object_set_data(G_OBJECT(state->overview_item), "image", image);
+        g_object_add_weak_pointer(G_OBJECT(state->overview_item), (gpointer*) &state->overview_item);
+        g_signal_connect(state->overview_item, "clicked", G_CALLBACK(OverviewItemClicked), state->terminal);
+        gtk_container_add(GTK_CONTAINER(flow_box), state->overview_item);
+    }
+
+    GtkWidget* scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), flow_box);
+
+    gchar* size = g_format_size(ThumbnailBytes);
+    gchar* limit = g_format_size(THUMBNAIL_MEMORY_LIMIT);
+    gchar* status = g_strdup_printf("%u terminals, %u cached thumbnails using %s (limit %s)", g_list_length(Terminals), ThumbnailCount, size, limit);
+    GtkWidget* status_label = gtk_label_new(status);
+    gtk_label_set_xalign(GTK_LABEL(status_label), 0.0);
+    gtk_widget_set_margin_start(status_label, 5);
+    g_free(size);
+    g_free(limit);
+    g_free(status);
+
+    GtkWidget* vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_box_pack_start(GTK_BOX(vbox), scrolled_window, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), status_label, FALSE, FALSE, 5);
+    gtk_container_add(GTK_CONTAINER(Overview), vbox);
+    gtk_widget_show_all(Overview);
+    OverviewSource = g_idle_add_full(G_PRIORITY_LOW, FillOverview, NULL, NULL);
+}
+
+gboolean PtyReadable(gint fd, GIOCondition condition, gpointer data);
+gboolean FeedTimedOut(gpointer data);
+
+gsize FeedArchived(TerminalState* state, const gchar* data, gsize length) {
+    glong columns = MAX(vte_terminal_get_column_count(VTE_TERMINAL(state->terminal)), 1);
+    glong rows = 0, column = 0;
+    gsize end = 0;
+
+    while (end < length && rows < ARCHIVE_MARGIN_ROWS / 2) {
+        gchar c = data[end++];
+        if (c == '\n' || c == '\v' || c == '\f' || c == '\033' || ++column >= columns) {
+            rows++;
+            column = 0;
+        }
+    }
+    return FeedTerminal(state, data, end);
+}
+
+gboolean EmitChildExited(gpointer data) {
+    TerminalState* state = GetTerminalState(GTK_WIDGET(data));
+    if (state != NULL && !state->closed) {
+        g_signal_emit_by_name(data, "child-exited", state->exit_status);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void FeedHeld(TerminalState* state) {
+    while (state->held->len > 0 && state->feed_source == 0) {
+        const gchar* data = (const gchar*) state->held->data;
+        gsize length = state->held->len;
+        guint64 image_end = state->images_unplaced > 0 ? NextImageEnd(state) : 0;
+        if (image_end > state->fed_total && image_end - state->fed_total < length) {
+            length = image_end - state->fed_total;
+        }
+        gsize fed = state->archive != NULL ? FeedArchived(state, data, length) : FeedTerminal(state, data, length);
+        g_byte_array_remove_range(state->held, 0, fed);
+        state->fed_total += fed;
+        if (state->mark_pending || (state->archive != NULL && state->fed_unprocessed) || (image_end > 0 && state->fed_total == image_end)) {
+            state->feed_source = g_timeout_add(FEED_BARRIER_TIMEOUT, FeedTimedOut, state);
+        }
+    }
+}
+
+void FlushInput(TerminalState* state) {
+    if (state->images && state->input->len > 0) {
+        FilterImages(state);
+    }
+    if (state->input->len > 0) {
+        if (CurrentSettings->trigger_regex != NULL) {
+            QueueTriggerInput(state, (const gchar*) state->input->data, state->input->len);
+        }
+        state->held_total += state->input->len;
+        if (state->held->len == 0) {
+            GByteArray* held = state->held;
+            state->held = state->input;
+            state->input = held;
+        } else {
+            g_byte_array_append(state->held, state->input->data, state->input->len);
+            g_byte_array_set_size(state->input, 0);
+        }
+        FeedBatches++;
+        InvalidateThumbnail(state);
+    }
+    FeedHeld(state);
+    if (state->read_paused && !state->closed && state->pty != NULL && state->held->len < FEED_INPUT_LIMIT) {
+        state->read_paused = FALSE;
+        state->read_source = g_unix_fd_add(vte_pty_get_fd(state->pty), G_IO_IN | G_IO_HUP | G_IO_ERR, PtyReadable, state);
+    }
+    if (state->exit_pending && state->held->len == 0 && state->feed_source == 0) {
+        state->exit_pending = FALSE;
+        g_idle_add_full(G_PRIORITY_DEFAULT, EmitChildExited, g_object_ref(state->terminal), g_object_unref);
+    }
+}
+
+void ReleaseFeed(TerminalState* state) {
+    state->fed_unprocessed = FALSE;
+    if (state->mark_pending) {
+        state->mark_pending = FALSE;
+        HandlePromptMark(state, state->mark);
+    }
+    FlushInput(state);
+}
+
+gboolean FeedTimedOut(gpointer data) {
+    TerminalState* state = data;
+    state->feed_source = 0;
+    if (state->archive != NULL) {
+        ArchiveRows(state);
+    }
+    if (state->images_unplaced > 0) {
+        PlaceImages(state);
+    }
+    ReleaseFeed(state);
+    return G_SOURCE_REMOVE;
+}
+
+void FeedProcessed(VteTerminal* terminal, gpointer data) {
+    TerminalState* state = GetTerminalState(GTK_WIDGET(terminal));
+    if (state == NULL) {
+        return;
+    }
+    state->fed_unprocessed = FALSE;
+    if (state->archive != NULL) {
+        ArchiveRows(state);
+    }
+    if (state->images_unplaced > 0) {
+        PlaceImages(state);
+    }
+    if (state->feed_source != 0) {
+        g_source_remove(state->feed_source);
+        state->feed_source = 0;
+        ReleaseFeed(state);
+    }
+}
+
+void FlushWindowInput(GtkWidget* window) {
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        if (state->window == window) {
+            FlushInput(state);
+        }
+    }
+}
+
+gboolean FeedTick(GtkWidget* window, GdkFrameClock* clock, gpointer data) {
+    g_object_set_data(G_OBJECT(window), "feed-tick", NULL);
+    FlushWindowInput(window);
+    return G_SOURCE_REMOVE;
+}
+
+void ScheduleFeed(TerminalState* state) {
+    GdkWindow* gdk_window = gtk_widget_get_window(state->window);
+    if (!gtk_widget_get_mapped(state->terminal) || gdk_window == NULL || (gdk_window_get_state(gdk_window) & GDK_WINDOW_STATE_ICONIFIED)) {
+        FlushInput(state);
+        return;
+    }
+    if (g_object_get_data(G_OBJECT(state->window), "feed-tick") == NULL) {
+        guint tick = gtk_widget_add_tick_callback(state->window, FeedTick, NULL, NULL);
+        g_object_set_data(G_OBJECT(state->window), "feed-tick", GUINT_TO_POINTER(tick));
+    }
+}
+
+gssize PtyRead(TerminalState* state, gint fd) {
+    gchar buffer[PTY_READ_SIZE];
+    gssize length = read(fd, buffer, sizeof(buffer));
+
+    if (length > 0) {
+        state->bytes_in += length;
+        atomic_fetch_add_explicit(&MetricBytesIn, length, memory_order_relaxed);
+        state->last_output = g_get_monotonic_time();
+        WakeHeartbeat();
+        if (state->latency_count > 0) {
+            LatencyEchoed(state, g_get_monotonic_time(), buffer, length);
+        }
+        g_byte_array_append(state->input, (const guint8*) buffer, length);
+        ScheduleFeed(state);
+    }
+    return length;
+}
+
+gboolean PtyReadable(gint fd, GIOCondition condition, gpointer data) {
+    TerminalState* state = data;
+    gssize length = PtyRead(state, fd);
+
+    if (length > 0 && state->input->len + state->held->len >= FEED_INPUT_LIMIT) {
+        state->read_paused = TRUE;
+        state->read_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    if (length > 0 || (length < 0 && (errno == EAGAIN || errno == EINTR))) {
+        return G_SOURCE_CONTINUE;
+    }
+    state->read_source = 0;
+    return G_SOURCE_REMOVE;
+}
+
+void FlushPtySize(TerminalState* state) {
+    if (state->pty == NULL || (state->pending_rows == state->pty_rows && state->pending_columns == state->pty_columns)) {
+        return;
+    }
+    state->pty_rows = state->pending_rows;
+    state->pty_columns = state->pending_columns;
+    vte_pty_set_size(state->pty, state->pty_rows, state->pty_columns, NULL);
+    SentWinches++;
+}
+
+gboolean PtySizeTick(GtkWidget* widget, GdkFrameClock* clock, gpointer data) {
+    TerminalState* state = data;
+    state->size_tick = 0;
+    FlushPtySize(state);
+    return G_SOURCE_REMOVE;
+}
+
+gboolean PtySizeSettled(gpointer data) {
+    TerminalState* state = data;
+    state->size_settle_source = 0;
+    FlushPtySize(state);
+    return G_SOURCE_REMOVE;
+}
+
+void UpdatePtySize(GtkWidget* widget, GdkRectangle* allocation, gpointer data) {
+    TerminalState* state = GetTerminalState(widget);
+    if (state == NULL || state->pty == NULL) {
+        return;
+    }
+    glong rows = vte_terminal_get_row_count(VTE_TERMINAL(widget));
+    glong columns = vte_terminal_get_column_count(VTE_TERMINAL(widget));
+
+    if (rows == state->pending_rows && columns == state->pending_columns) {
+        return;
+    }
+    if (state->pending_rows != state->pty_rows || state->pending_columns != state->pty_columns) {
+        SuppressedWinches++;
+    }
+    state->pending_rows = rows;
+    state->pending_columns = columns;
+
+    if (state->size_tick == 0) {
+        state->size_tick = gtk_widget_add_tick_callback(widget, PtySizeTick, state, NULL);
+    }
+    if (state->size_settle_source != 0) {
+        g_source_remove(state->size_settle_source);
+    }
+    state->size_settle_source = g_timeout_add(PTY_SIZE_SETTLE_DELAY, PtySizeSettled, state);
+}
+
+gboolean IsBroadcasting(TerminalState* state) {
+    switch (BroadcastMode) {
+    case BROADCAST_WINDOW:
+        return state->window == BroadcastWindow;
+    case BROADCAST_ALL:
+        return TRUE;
+    case BROADCAST_GROUP:
+        return state->broadcast_group;
+    default:
+        return FALSE;
+    }
+}
+
+gboolean FlushBroadcast(gpointer data) {
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        if (state->broadcast_input->len > 0) {
+            PtyWrite(state, (const gchar*) state->broadcast_input->data, state->broadcast_input->len);
+            g_byte_array_set_size(state->broadcast_input, 0);
+        }
+    }
+    BroadcastSource = 0;
+    return G_SOURCE_REMOVE;
+}
+
+void BroadcastInput(TerminalState* source, const gchar* text, gsize length) {
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        if (state == source || state->pty == NULL || !IsBroadcasting(state)) {
+            continue;
+        }
+        if (state->output->len + state->broadcast_input->len + length > BROADCAST_QUEUE_LIMIT) {
+            state->broadcast_dropped += length;
+            continue;
+        }
+        g_byte_array_append(state->broadcast_input, (const guint8*) text, length);
+        if (BroadcastSource == 0) {
+            BroadcastSource = g_idle_add_full(G_PRIORITY_HIGH_IDLE, FlushBroadcast, NULL, NULL);
+        }
+    }
+}
+
+void BroadcastPaste(TerminalState* source) {
+    if (source == NULL || BroadcastMode == BROADCAST_OFF || !IsBroadcasting(source)) {
+        return;
+    }
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        if (state != source && state->pty != NULL && IsBroadcasting(state)) {
+            vte_terminal_paste_clipboard(VTE_TERMINAL(state->terminal));
+        }
+    }
+}
+
+gboolean TypingFinished(gpointer data) {
+    TypingTerminal = NULL;
+    TypingSource = 0;
+    return G_SOURCE_REMOVE;
+}
+
+gboolean BroadcastKeyPress(GtkWidget* widget, GdkEventKey* event, gpointer data) {
+    if (BroadcastMode != BROADCAST_OFF && gtk_widget_has_focus(widget)) {
+        TypingTerminal = widget;
+        if (TypingSource == 0) {
+            TypingSource = g_idle_add_full(G_PRIORITY_HIGH, TypingFinished, NULL, NULL);
+        }
+    }
+    return FALSE;
+}
+
+void BroadcastTyped(VteTerminal* terminal, gchar* text, guint size, gpointer data) {
+    TerminalState* state = GetTerminalState(GTK_WIDGET(terminal));
+    if (state != NULL && TypingTerminal == GTK_WIDGET(terminal) && IsBroadcasting(state)) {
+        BroadcastInput(state, text, size);
+    }
+}
+
+void Commit(VteTerminal* terminal, gchar* text, guint size, gpointer data) {
+    TerminalState* state = GetTerminalState(GTK_WIDGET(terminal));
+    if (state != NULL) {
+        PtyWrite(state, text, size);
+    }
+}
+
+gboolean TerminalFocused(GtkWidget* widget, GdkEvent* event, gpointer data) {
+    ActiveTerminal = widget;
+    TerminalState* state = GetTerminalState(widget);
+    if (state != NULL && state->trigger_marked) {
+        MarkTab(state, FALSE);
+    }
+    if (state != NULL && g_object_get_data(G_OBJECT(state->page), "terminal") != widget) {
+        g_object_set_data(G_OBJECT(state->page), "terminal", widget);
+        UpdateTabLabel(state);
+        SetWindowTitle(state->window, GetNewWindowTitle(VTE_TERMINAL(widget)));
+    }
+    return FALSE;
+}
+
+void TerminalUnmapped(GtkWidget* widget, gpointer data) {
+    TerminalState* state = GetTerminalState(widget);
+    if (state != NULL) {
+        FlushInput(state);
+    }
+}
+
+gboolean WindowStateChanged(GtkWidget* window, GdkEventWindowState* event, gpointer data) {
+    if (event->new_window_state & GDK_WINDOW_STATE_ICONIFIED) {
+        FlushWindowInput(window);
+    }
+    return FALSE;
+}
+
+void ChildWatch(GPid pid, gint status, gpointer data) {
+    GtkWidget* terminal = GTK_WIDGET(data);
+    TerminalState* state = GetTerminalState(terminal);
+
+    g_spawn_close_pid(pid);
+    if (state == NULL || state->closed) {
+        return;
+    }
+    if (state->read_source != 0) {
+        while (state->input->len < FEED_INPUT_LIMIT && PtyRead(state, vte_pty_get_fd(state->pty)) > 0) {
+        }
+    }
+    FlushInput(state);
+    if (state->held->len > 0 || state->feed_source != 0) {
+        state->exit_pending = TRUE;
+        state->exit_status = status;
+        return;
+    }
+    g_signal_emit_by_name(terminal, "child-exited", status);
+}
+
+void ChildStarted(TerminalState* state, GPid pid, GError* error) {
+    if (pid > 0) {
+        ObserveHistogram(&SpawnHistogram, g_get_monotonic_time() - state->spawned_at);
+        gint fd = vte_pty_get_fd(state->pty);
+        g_unix_set_fd_nonblocking(fd, TRUE, NULL);
+        state->read_source = g_unix_fd_add(fd, G_IO_IN | G_IO_HUP | G_IO_ERR, PtyReadable, state);
+        g_child_watch_add_full(G_PRIORITY_DEFAULT, pid, ChildWatch, g_object_ref(state->terminal), g_object_unref);
+    }
+    ChildReady(VTE_TERMINAL(state->terminal), pid, error, state->window);
+}
+
+void PtySpawned(GObject* source, GAsyncResult* result, gpointer data) {
+    GtkWidget* terminal = GTK_WIDGET(data);
+    TerminalState* state = GetTerminalState(terminal);
+    GError* error = NULL;
+    GPid pid = 0;
+
+    if (!vte_pty_spawn_finish(VTE_PTY(source), result, &pid, &error)) {
+        pid = 0;
+    }
+    if (state != NULL && !state->closed) {
+        ChildStarted(state, pid, error);
+    }
+    g_clear_error(&error);
+    g_object_unref(terminal);
+}
+
+void PipedChildSetup(gpointer data) {
+    gint input = dup(STDIN_FILENO);
+    vte_pty_child_setup(VTE_PTY(data));
+    dup2(input, STDIN_FILENO);
+    close(input);
+}
+
+void SpawnPiped(TerminalState* state, const gchar* directory, gchar** argv, gchar** environment, gint* input) {
+    gint fds[2] = {-1, -1};
+    GPid pid = 0;
+    GError* error = NULL;
+    gchar** child_environment = g_environ_setenv(g_strdupv(environment), "TERM", "xterm-256color", TRUE);
+    child_environment = g_environ_setenv(child_environment, "COLORTERM", "truecolor", TRUE);
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+        g_set_error_literal(&error, G_IO_ERROR, g_io_error_from_errno(errno), g_strerror(errno));
+    } else if (g_spawn_async_with_fds(directory, argv, child_environment, G_SPAWN_DO_NOT_REAP_CHILD, PipedChildSetup, state->pty,
+                                      &pid, fds[1], -1, -1, &error)) {
+        *input = fds[0];
+        fds[0] = -1;
+    }
+    for (gint i = 0; i < 2; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    ChildStarted(state, pid, error);
+    g_clear_error(&error);
+    g_strfreev(child_environment);
+}
+
+gboolean HudDraw(GtkWidget* widget, cairo_t* cr, gpointer data) {
+    TerminalState* state = data;
+    state->draw_started = g_get_monotonic_time();
+    return FALSE;
+}
+
+gboolean HudDrawn(GtkWidget* widget, cairo_t* cr, gpointer data) {
+    TerminalState* state = data;
+    state->draw_times[state->draw_count % HUD_DRAW_SAMPLES] = g_get_monotonic_time() - state->draw_started;
+    state->draw_count++;
+    state->frames++;
+    return FALSE;
+}
+
+void RefreshHud(TerminalState* state, gint64 now) {
+    gdouble elapsed = (now - state->hud_sampled_at) / (gdouble) G_USEC_PER_SEC;
+    if (elapsed <= 0) {
+        return;
+    }
+    gdouble bytes_rate = (state->bytes_in - state->hud_bytes_mark) / elapsed;
+    gdouble fps = (state->frames - state->hud_frames_mark) / elapsed;
+    state->hud_bytes_mark = state->bytes_in;
+    state->hud_frames_mark = state->frames;
+    state->hud_sampled_at = now;
+
+    gint64 samples[HUD_DRAW_SAMPLES];
+    guint count = MIN(state->draw_count, HUD_DRAW_SAMPLES);
+    gint64 last = 0, p99 = 0;
+    if (count > 0) {
+        last = state->draw_times[(state->draw_count - 1) % HUD_DRAW_SAMPLES];
+        memcpy(samples, state->draw_times, count * sizeof(gint64));
+        qsort(samples, count, sizeof(gint64), CompareTimes);
+        p99 = samples[(count * 99 + 99) / 100 - 1];
+    }
+
+    GtkAdjustment* adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(state->terminal));
+    glong rows = (glong) (gtk_adjustment_get_upper(adjustment) - gtk_adjustment_get_lower(adjustment));
+    glong columns = vte_terminal_get_column_count(VTE_TERMINAL(state->terminal));
+
+    gchar* in = g_format_size((guint64) bytes_rate);
+    gchar* memory = g_format_size((guint64) rows * columns * HUD_BYTES_PER_CELL);
+    gchar* queue = g_format_size(state->output->len);
+    gchar* skipped = g_format_size(state->trigger_skipped);
+    gchar* dropped = g_format_size(state->broadcast_dropped);
+    gchar* thumbnails = g_format_size(ThumbnailBytes);
+    gchar* images = g_format_size(ImageBytes);
+    gchar* text = g_strdup_printf("PTY in   %s/s\n"
+                                  "FPS      %.1f\n"
+                                  "Draw     %.2f ms (p99 %.2f ms)\n"
+                                  "Rows     %ld (~%s)\n"
+                                  "Queue    %s\n"
+                                  "Resize   %.2f ms (max %.2f ms)\n"
+                                  "SIGWINCH %" G_GUINT64_FORMAT " sent, %" G_GUINT64_FORMAT " suppressed\n"
+                                  "Palette  %.2f ms apply, %.2f ms paint (%u terminals)\n"
+                                  "Triggers %" G_GUINT64_FORMAT " hits, %s skipped, %.1f ms this second\n"
+                                  "Broadcast %s, %s dropped\n"
+                                  "Wakeups  %.1f/s (HUD adds %d)\n"
+                                  "Thumbs   %u cached, %s\n"
+                                  "Images   %u, %s of %ld MiB, %" G_GUINT64_FORMAT " not shown",
+                                  in, fps, last / 1000.0, p99 / 1000.0, rows, memory, queue,
+                                  ResizeStallLast / 1000.0, ResizeStallMax / 1000.0,
+                                  SentWinches, SuppressedWinches,
+                                  PaletteSwitchApply / 1000.0, PaletteSwitchFrame / 1000.0, PaletteSwitchTerminals,
+                                  state->trigger_hits, skipped, state->trigger_used / 1000.0,
+                                  IsBroadcasting(state) ? "on" : "off", dropped,
+                                  HudWakeupRate, 1000 / HUD_REFRESH_INTERVAL,
+                                  ThumbnailCount, thumbnails,
+                                  g_queue_get_length(&Images), images, CurrentSettings->image_memory, state->images_dropped);
+    gtk_label_set_text(GTK_LABEL(state->hud), text);
+
+    g_free(in);
+    g_free(memory);
+    g_free(queue);
+    g_free(skipped);
+    g_free(dropped);
+    g_free(thumbnails);
+    g_free(images);
+    g_free(text);
+}
+
+gboolean RefreshHuds(gpointer data) {
+    gint64 now = g_get_monotonic_time();
+    HudWakeupRate = (Wakeups - HudWakeupsMark) * (gdouble) G_USEC_PER_SEC / MAX(now - HudWakeupsSampled, 1);
+    HudWakeupsMark = Wakeups;
+    HudWakeupsSampled = now;
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        if (state->hud_draw_handler != 0) {
+            RefreshHud(state, now);
+        }
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void InstallStyle(void) {
+    static gboolean installed = FALSE;
+    if (installed) {
+        return;
+    }
+    GtkCssProvider* provider = gtk_css_provider_new();
+    gtk_css_provider_load_from_data(provider,
+                                    ".hud { background-color: rgba(0, 0, 0, 0.7); color: #e0e0e0; font-family: monospace; font-size: 9pt; padding: 4px 6px; }"
+                                    ".marked { color: #e01b24; font-weight: bold; }"
+                                    ".activity { font-weight: bold; }"
+                                    ".silent { font-style: italic; color: #986a44; }"
+                                    ".broadcast { background-color: #c01c28; color: #ffffff; font-weight: bold; padding: 2px 6px; }", -1, NULL);
+    gtk_style_context_add_provider_for_screen(gdk_screen_get_default(), GTK_STYLE_PROVIDER(provider), GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+    g_object_unref(provider);
+    installed = TRUE;
+}
+
+void HideHud(TerminalState* state) {
+    if (state->hud_draw_handler == 0) {
+        return;
+    }
+    g_signal_handler_disconnect(state->terminal, state->hud_draw_handler);
+    g_signal_handler_disconnect(state->terminal, state->hud_drawn_handler);
+    state->hud_draw_handler = 0;
+    state->hud_drawn_handler = 0;
+    gtk_widget_hide(state->hud);
+
+    if (--HudCount == 0 && HudSource != 0) {
+        g_source_remove(HudSource);
+        HudSource = 0;
+    }
+}
+
+void ShowHud(TerminalState* state) {
+    if (state->hud_draw_handler != 0 || state->overlay == NULL) {
+        return;
+    }
+    if (state->hud == NULL) {
+        InstallStyle();
+        state->hud = gtk_label_new(NULL);
+        gtk_widget_set_halign(state->hud, GTK_ALIGN_END);
+        gtk_widget_set_valign(state->hud, GTK_ALIGN_START);
+        gtk_widget_set_margin_top(state->hud, 5);
+        gtk_widget_set_margin_end(state->hud, 20);
+        gtk_style_context_add_class(gtk_widget_get_style_context(state->hud), "hud");
+        gtk_overlay_add_overlay(GTK_OVERLAY(state->overlay), state->hud);
+        gtk_overlay_set_overlay_pass_through(GTK_OVERLAY(state->overlay), state->hud, TRUE);
+    }
+    state->hud_draw_handler = g_signal_connect(state->terminal, "draw", G_CALLBACK(HudDraw), state);
+    state->hud_drawn_handler = g_signal_connect_after(state->terminal, "draw", G_CALLBACK(HudDrawn), state);
+    state->hud_bytes_mark = state->bytes_in;
+    state->hud_frames_mark = state->frames;
+    state->hud_sampled_at = g_get_monotonic_time();
+    state->draw_count = 0;
+    gtk_label_set_text(GTK_LABEL(state->hud), "Sampling...");
+    gtk_widget_show(state->hud);
+
+    if (HudCount++ == 0) {
+        HudSource = g_timeout_add(HUD_REFRESH_INTERVAL, RefreshHuds, NULL);
+    }
+}
+
+void ToggleHud(void) {
+    TerminalState* state = GetActiveTerminalState();
+    if (state == NULL) {
+        return;
+    }
+    if (state->hud_draw_handler != 0) {
+        HideHud(state);
+    } else {
+        ShowHud(state);
+    }
+}
+
+void UpdateBroadcastIndicator(TerminalState* state) {
+    gboolean broadcasting = IsBroadcasting(state);
+    GtkStyleContext* context = gtk_widget_get_style_context(state->tab_label);
+
+    if (broadcasting) {
+        gtk_style_context_add_class(context, "broadcast");
+    } else {
+        gtk_style_context_remove_class(context, "broadcast");
+    }
+    if (state->broadcast_badge == NULL && broadcasting && state->overlay != NULL) {
+        InstallStyle();
+        state->broadcast_badge = gtk_label_new("BROADCAST");
+        gtk_widget_set_halign(state->broadcast_badge, GTK_ALIGN_END);
+        gtk_widget_set_valign(state->broadcast_badge, GTK_ALIGN_END);
+        gtk_widget_set_margin_bottom(state->broadcast_badge, 5);
+        gtk_widget_set_margin_end(state->broadcast_badge, 20);
+        gtk_style_context_add_class(gtk_widget_get_style_context(state->broadcast_badge), "broadcast");
+        gtk_overlay_add_overlay(GTK_OVERLAY(state->overlay), state->broadcast_badge);
+        gtk_overlay_set_overlay_pass_through(GTK_OVERLAY(state->overlay), state->broadcast_badge, TRUE);
+    }
+    if (state->broadcast_badge != NULL) {
+        gtk_widget_set_visible(state->broadcast_badge, broadcasting);
+    }
+}
+
+void UpdateBroadcastIndicators(void) {
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        UpdateBroadcastIndicator(l->data);
+    }
+}
+
+void SetBroadcastMode(gint mode) {
+    TerminalState* state = GetActiveTerminalState();
+    if (BroadcastWindow != NULL) {
+        g_object_remove_weak_pointer(G_OBJECT(BroadcastWindow), (gpointer*) &BroadcastWindow);
+        BroadcastWindow = NULL;
+    }
+    BroadcastMode = BroadcastMode == mode ? BROADCAST_OFF : mode;
+
+    if (BroadcastMode == BROADCAST_WINDOW) {
+        if (state == NULL) {
+            BroadcastMode = BROADCAST_OFF;
+        } else {
+            BroadcastWindow = state->window;
+            g_object_add_weak_pointer(G_OBJECT(BroadcastWindow), (gpointer*) &BroadcastWindow);
+        }
+    }
+    if (BroadcastMode == BROADCAST_GROUP && state != NULL && !state->broadcast_group) {
+        state->broadcast_group = TRUE;
+    }
+    UpdateBroadcastIndicators();
+}
+
+void BroadcastToWindow(void) {
+    SetBroadcastMode(BROADCAST_WINDOW);
+}
+
+void BroadcastToAll(void) {
+    if (WindowsSpread("Broadcast to All Tabs")) {
+        return;
+    }
+    SetBroadcastMode(BROADCAST_ALL);
+}
+
+void BroadcastToGroup(void) {
+    SetBroadcastMode(BROADCAST_GROUP);
+}
+
+void ToggleBroadcastGroup(void) {
+    TerminalState* state = GetActiveTerminalState();
+    if (state == NULL) {
+        return;
+    }
+    state->broadcast_group = !state->broadcast_group;
+    UpdateBroadcastIndicator(state);
+}
+
+glong GetScrollbackRows(TerminalState* state) {
+    GtkAdjustment* adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(state->terminal));
+    return (glong) (gtk_adjustment_get_upper(adjustment) - gtk_adjustment_get_lower(adjustment));
+}
+
+gboolean SettleResize(gpointer data) {
+    TerminalState* state = data;
+    state->rewrap_source = 0;
+
+    if (state->rewrap_deferred) {
+        G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+        vte_terminal_set_rewrap_on_resize(VTE_TERMINAL(state->terminal), TRUE);
+        G_GNUC_END_IGNORE_DEPRECATIONS
+        state->rewrap_deferred = FALSE;
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void BeginResize(TerminalState* state) {
+    g_object_set_data(G_OBJECT(state->window), "resize-pending", GINT_TO_POINTER(TRUE));
+
+    if (!state->rewrap_deferred && GetScrollbackRows(state) > REWRAP_DEFER_ROWS) {
+        G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+        vte_terminal_set_rewrap_on_resize(VTE_TERMINAL(state->terminal), FALSE);
+        G_GNUC_END_IGNORE_DEPRECATIONS
+        state->rewrap_deferred = TRUE;
+    }
+    if (state->rewrap_deferred) {
+        if (state->rewrap_source != 0) {
+            g_source_remove(state->rewrap_source);
+        }
+        state->rewrap_source = g_timeout_add(REWRAP_SETTLE_DELAY, SettleResize, state);
+    }
+}
+
+gboolean WindowConfigured(GtkWidget* window, GdkEventConfigure* event, gpointer data) {
+    gint width = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(window), "configured-width"));
+    gint height = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(window), "configured-height"));
+
+    if (event->width == width && event->height == height) {
+        return FALSE;
+    }
+    g_object_set_data(G_OBJECT(window), "configured-width", GINT_TO_POINTER(event->width));
+    g_object_set_data(G_OBJECT(window), "configured-height", GINT_TO_POINTER(event->height));
+
+    for (GList* l = Terminals; l != NULL; l = l->next) {
+        TerminalState* state = l->data;
+        if (state->window == window) {
+            BeginResize(state);
+        }
     }
+    return FALSE;
 }
 
-void DestroyWindow(GtkWidget* widget, gpointer data) {
-    if (widget != NULL) {
-        gtk_widget_destroy(widget);
+void AllocationStarted(GtkContainer* window, gpointer data) {
+    if (g_object_get_data(G_OBJECT(window), "resize-pending") != NULL) {
+        LayoutStarted = g_get_monotonic_time();
     }
 }
 
-void DestroyAndQuit(GtkWidget* window, gint status) {
-    GApplicationCommandLine* cli = g_object_get_data(G_OBJECT(window), "cli");
-    if (cli != NULL) {
-        SetExitStatus(cli, status);
+void AllocationFinished(GtkContainer* window, gpointer data) {
+    if (LayoutStarted == 0 || g_object_get_data(G_OBJECT(window), "resize-pending") == NULL) {
+        return;
     }
-    DestroyWindow(window, NULL);
+    ResizeStallLast = g_get_monotonic_time() - LayoutStarted;
+    ResizeStallMax = MAX(ResizeStallMax, ResizeStallLast);
+    ResizeCount++;
+    LayoutStarted = 0;
+    g_object_set_data(G_OBJECT(window), "resize-pending", NULL);
 }
 
-void HandleChildExit(GtkWidget* window, gint status) {
-    DestroyAndQuit(window, status);
+gboolean PaletteDrawn(GtkWidget* widget, cairo_t* cr, gpointer data) {
+    g_signal_handlers_disconnect_by_func(widget, PaletteDrawn, data);
+    if (PalettePendingDraws > 0 && --PalettePendingDraws == 0) {
+        PaletteSwitchFrame = g_get_monotonic_time() - PaletteSwitchStarted;
+    }
+    return FALSE;
 }
 
-gboolean ChildExited(VteTerminal* term, gint status, gpointer data) {
-    GtkWidget* window = GTK_WIDGET(data);
-    HandleChildExit(window, status);
-    return TRUE;
+void FreeTrigger(gpointer data) {
+    Trigger* trigger = data;
+    g_free(trigger->name);
+    g_free(trigger->pattern);
+    g_free(trigger->literal);
+    g_free(trigger->prefilter);
+    if (trigger->highlight != NULL) {
+        vte_regex_unref(trigger->highlight);
+    }
+    g_free(trigger);
 }
 
-void NewWindow(void) {
-    GError *error = NULL;
-    gchar *argv[] = {"illumiterm", NULL};
-
-    gboolean success = g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, NULL, &error);
+gchar* GetRequiredLiteral(const gchar* pattern) {
+    if (strchr(pattern, '|') != NULL || strstr(pattern, "(?") != NULL) {
+        return NULL;
+    }
+    const gchar* best = NULL;
+    const gchar* run = NULL;
+    gsize best_length = 0;
+    gboolean in_class = FALSE;
+    gint depth = 0;
+
+    for (const gchar* p = pattern; ; p++) {
+        gboolean literal = *p != '\0' && !in_class && depth == 0 && (g_ascii_isalnum(*p) || strchr(" _-:=,;'\"/<>!@#%&~", *p) != NULL);
+        if (literal && run == NULL) {
+            run = p;
+        } else if (!literal && run != NULL) {
+            gsize length = p - run;
+            if (*p == '?' || *p == '*' || *p == '{') {
+                length--;
+            }
+            if (length > best_length) {
+                best = run;
+                best_length = length;
+            }
+            run = NULL;
+        }
 
-    if (!success) {
-        g_error_free(error);
+        if (*p == '\0') {
+            break;
+        } else if (*p == '\\' && p[1] != '\0') {
+            p++;
+        } else if (*p == '[') {
+            in_class = TRUE;
+        } else if (*p == ']') {
+            in_class = FALSE;
+        } else if (!in_class && *p == '(') {
+            depth++;
+        } else if (!in_class && *p == ')') {
+            depth--;
+        }
     }
+    return best_length >= TRIGGER_LITERAL_MIN ? g_strndup(best, best_length) : NULL;
 }
 
-void NewTab(void) {
-    g_print("NewTab\n");
+void CompileTriggers(Settings* settings) {
+    GPtrArray* triggers = settings->triggers;
+    GString* combined = g_string_new(NULL);
+    GString* literals = g_string_new(NULL);
+    gboolean prefilter = triggers->len > 0;
+    gint group = 1;
+
+    for (guint i = 0; i < triggers->len; ) {
+        Trigger* trigger = g_ptr_array_index(triggers, i);
+        GError* error = NULL;
+        GRegex* regex = g_regex_new(trigger->pattern, G_REGEX_RAW, 0, &error);
+        if (regex == NULL) {
+            g_printerr("Ignoring trigger %s: %s\n", trigger->name, error->message);
+            g_error_free(error);
+            g_ptr_array_remove_index(triggers, i);
+            continue;
+        }
+        trigger->group = group;
+        group += g_regex_get_capture_count(regex) + 1;
+        g_regex_unref(regex);
+        g_string_append_printf(combined, "%s(%s)", combined->len > 0 ? "|" : "", trigger->pattern);
+
+        trigger->prefilter = trigger->literal != NULL ? g_strdup(trigger->literal) : GetRequiredLiteral(trigger->pattern);
+        if (trigger->prefilter == NULL || trigger->prefilter[0] == '\0') {
+            prefilter = FALSE;
+        } else {
+            gchar* escaped = g_regex_escape_string(trigger->prefilter, -1);
+            g_string_append_printf(literals, "%s%s", literals->len > 0 ? "|" : "", escaped);
+            g_free(escaped);
+        }
+        if (trigger->actions & TRIGGER_HIGHLIGHT) {
+            trigger->highlight = vte_regex_new_for_match(trigger->pattern, -1, PCRE2_MULTILINE, NULL);
+        }
+        i++;
+    }
+    if (triggers->len > 0) {
+        settings->trigger_regex = g_regex_new(combined->str, G_REGEX_RAW | G_REGEX_OPTIMIZE, 0, NULL);
+    }
+    if (prefilter) {
+        settings->trigger_literals = g_regex_new(literals->str, G_REGEX_RAW | G_REGEX_OPTIMIZE, 0, NULL);
+    }
+    g_string_free(combined, TRUE);
+    g_string_free(literals, TRUE);
 }
 
-void Copy(void) {
-    g_print("Copy\n");
+void ReadTriggers(GKeyFile* file, Settings* settings) {
+    gchar** groups = g_key_file_get_groups(file, NULL);
+
+    for (gchar** group = groups; *group != NULL; group++) {
+        gchar* pattern = g_str_has_prefix(*group, "Trigger ") ? g_key_file_get_string(file, *group, "Pattern", NULL) : NULL;
+        if (pattern == NULL) {
+            continue;
+        }
+        Trigger* trigger = g_new0(Trigger, 1);
+        trigger->name = g_strdup(*group + strlen("Trigger "));
+        trigger->pattern = pattern;
+        trigger->literal = g_key_file_get_string(file, *group, "Literal", NULL);
+
+        gchar** actions = g_key_file_get_string_list(file, *group, "Actions", NULL, NULL);
+        for (gchar** action = actions; action != NULL && *action != NULL; action++) {
+            for (guint i = 0; i < G_N_ELEMENTS(TriggerActionNames); i++) {
+                if (g_strcmp0(*action, TriggerActionNames[i]) == 0) {
+                    trigger->actions |= 1 << i;
+                }
+            }
+        }
+        g_strfreev(actions);
+        if (trigger->actions == 0) {
+            trigger->actions = TRIGGER_MARK;
+        }
+        g_ptr_array_add(settings->triggers, trigger);
+    }
+    g_strfreev(groups);
 }
 
-void Paste(void) {
-    g_print("Paste\n");
+void WriteTriggers(GKeyFile* file, const Settings* settings) {
+    for (guint i = 0; i < settings->triggers->len; i++) {
+        Trigger* trigger = g_ptr_array_index(settings->triggers, i);
+        gchar* group = g_strconcat("Trigger ", trigger->name, NULL);
+        const gchar* actions[G_N_ELEMENTS(TriggerActionNames)];
+        gsize count = 0;
+
+        g_key_file_set_string(file, group, "Pattern", trigger->pattern);
+        if (trigger->literal != NULL) {
+            g_key_file_set_string(file, group, "Literal", trigger->literal);
+        }
+        for (guint j = 0; j < G_N_ELEMENTS(TriggerActionNames); j++) {
+            if (trigger->actions & (1 << j)) {
+                actions[count++] = TriggerActionNames[j];
+            }
+        }
+        g_key_file_set_string_list(file, group, "Actions", actions, count);
+        g_free(group);
+    }
 }
 
-void ClearScrollback(void) {
-    g_print("ClearScrollback\n");
+guint64 ShortcutKey(guint keyval, GdkModifierType modifiers) {
+    return (guint64) modifiers << 32 | gdk_keyval_to_lower(keyval);
 }
 
-void NameTab(void) {
-    GtkWidget *dialog = gtk_dialog_new_with_buttons("Name Tab", NULL, GTK_DIALOG_MODAL, "Cancel", GTK_RESPONSE_CANCEL, "OK", GTK_RESPONSE_OK, NULL);
+gboolean ParseShortcut(const gchar* text, guint* keyval, GdkModifierType* modifiers) {
+    *keyval = 0;
+    *modifiers = 0;
+    gsize length = strlen(text);
+    if (length == 0) {
+        return TRUE;
+    }
+    const gchar* key = text[length - 1] == '+' ? text + length - 1 : strrchr(text, '+');
+    key = key == NULL ? text : key == text + length - 1 ? key : key + 1;
+
+    gchar* prefix = g_strndup(text, key - text);
+    gchar** parts = g_strsplit(prefix, "+", -1);
+    gboolean valid = TRUE;
+    for (gint i = 0; parts[i] != NULL && valid; i++) {
+        gchar* part = g_strstrip(parts[i]);
+        if (part[0] == '\0') {
+            continue;
+        } else if (g_ascii_strcasecmp(part, "Shift") == 0) {
+            *modifiers |= GDK_SHIFT_MASK;
+        } else if (g_ascii_strcasecmp(part, "Ctrl") == 0 || g_ascii_strcasecmp(part, "Control") == 0) {
+            *modifiers |= GDK_CONTROL_MASK;
+        } else if (g_ascii_strcasecmp(part, "Alt") == 0) {
+            *modifiers |= GDK_MOD1_MASK;
+        } else if (g_ascii_strcasecmp(part, "Super") == 0) {
+            *modifiers |= GDK_SUPER_MASK;
+        } else {
+            valid = FALSE;
+        }
+    }
+    g_strfreev(parts);
+    g_free(prefix);
 
-    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    gchar* name = g_strstrip(g_strdup(key));
+    if (g_utf8_strlen(name, -1) == 1) {
+        *keyval = gdk_unicode_to_keyval(g_utf8_get_char(name));
+    } else {
+        g_strdelimit(name, " ", '_');
+        *keyval = gdk_keyval_from_name(name);
+    }
+    g_free(name);
 
-    GtkWidget *entry = gtk_entry_new();
-    gtk_entry_set_max_length(GTK_ENTRY(entry), 50);
-    gtk_widget_show(entry);
+    return valid && *keyval != 0 && *keyval != GDK_KEY_VoidSymbol;
+}
 
-    gchar *username = getlogin();
-    if (username != NULL) {
-        gchar hostname[1024];
-        gethostname(hostname, sizeof(hostname));
-        gchar *user_host = g_strdup_printf("%s@%s", username, hostname);
-        gtk_entry_set_text(GTK_ENTRY(entry), user_host);
-        g_free(user_host);
-    } else {
-        gtk_entry_set_text(GTK_ENTRY(entry), "Default Title");
-    }
-
-    char cwd[1024];
-    if (getcwd(cwd, sizeof(cwd)) != NULL) {
-        const gchar *home_dir = g_get_home_dir();
-        if (g_str_has_prefix(cwd, home_dir)) {
-            gchar *relative_path = g_strdup_printf("~%s", cwd + strlen(home_dir));
-            gchar *title_text = g_strdup_printf("%s:%s", gtk_entry_get_text(GTK_ENTRY(entry)), relative_path);
-            gtk_entry_set_text(GTK_ENTRY(entry), title_text);
-            g_free(relative_path);
-            g_free(title_text);
-        } else {
-            gchar *title_text = g_strdup_printf("%s:%s", gtk_entry_get_text(GTK_ENTRY(entry)), cwd);
-            gtk_entry_set_text(GTK_ENTRY(entry), title_text);
-            g_free(title_text);
+GHashTable* CompileKeybindings(gchar** shortcuts, GString* conflicts) {
+    GHashTable* keybindings = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+
+    for (gint i = 0; i < SHORTCUT_COUNT; i++) {
+        guint keyval;
+        GdkModifierType modifiers;
+        if (!ParseShortcut(shortcuts[i], &keyval, &modifiers)) {
+            g_string_append_printf(conflicts, "%s: cannot parse \"%s\"\n", ShortcutLabels[i], shortcuts[i]);
+            continue;
         }
+        if (keyval == 0) {
+            continue;
+        }
+        guint64 key = ShortcutKey(keyval, modifiers);
+        gint action = GPOINTER_TO_INT(g_hash_table_lookup(keybindings, &key));
+        if (action != 0) {
+            g_string_append_printf(conflicts, "%s: \"%s\" is already used by %s\n", ShortcutLabels[i], shortcuts[i], ShortcutLabels[action - 1]);
+            continue;
+        }
+        g_hash_table_insert(keybindings, g_memdup2(&key, sizeof(key)), GINT_TO_POINTER(i + 1));
     }
+    return keybindings;
+}
 
-    gtk_container_add(GTK_CONTAINER(content_area), entry);
+void CompileSettingsKeybindings(Settings* settings) {
+    GString* conflicts = g_string_new(NULL);
+    g_clear_pointer(&settings->keybindings, g_hash_table_unref);
+    settings->keybindings = CompileKeybindings(settings->shortcuts, conflicts);
+    if (conflicts->len > 0) {
+        g_printerr("Shortcuts: %s", conflicts->str);
+    }
+    g_string_free(conflicts, TRUE);
+}
 
-    gint result = gtk_dialog_run(GTK_DIALOG(dialog));
-    if (result == GTK_RESPONSE_OK) {
-        const gchar *name = gtk_entry_get_text(GTK_ENTRY(entry));
-        gtk_window_set_title(GTK_WINDOW(dialog), name);
+Settings* DefaultSettings(void) {
+    Settings* settings = g_new0(Settings, 1);
+    settings->font = g_strdup("Monospace 10");
+    gdk_rgba_parse(&settings->foreground, "gray");
+    gdk_rgba_parse(&settings->background, "black");
+    settings->palette = g_strdup("vga");
+    memcpy(settings->custom_palette, Palettes[0].colors, sizeof(settings->custom_palette));
+    settings->cursor_blink_time = 1200;
+    settings->cursor_blink_timeout = 10;
+    settings->allow_bold = TRUE;
+    settings->bold_is_bright = TRUE;
+    settings->cursor_blink = TRUE;
+    settings->cursor_shape = VTE_CURSOR_SHAPE_BLOCK;
+    settings->audible_bell = TRUE;
+    settings->tab_position = GTK_POS_TOP;
+    settings->columns = 80;
+    settings->rows = 24;
+    settings->scrollback = -1;
+    settings->hide_scrollbar = FALSE;
+    settings->hide_menu_bar = FALSE;
+    settings->hide_mouse_pointer = TRUE;
+    settings->word_chars = g_strdup(LINK_CHARS);
+    settings->pipe_command = g_strdup("${PAGER:-less}");
+    settings->disable_menu_key = FALSE;
+    settings->disable_confirm = FALSE;
+    settings->silence_seconds = 0;
+    settings->notify_tabs = FALSE;
+    settings->export_metrics = FALSE;
+    settings->archive_scrollback = FALSE;
+    settings->keep_archive = FALSE;
+    settings->inline_images = TRUE;
+    settings->image_memory = 64;
+    settings->window_processes = 1;
+    settings->accessibility = ACCESSIBILITY_AUTO;
+    for (gint i = 0; i < SHORTCUT_COUNT; i++) {
+        settings->shortcuts[i] = g_strdup(DefaultShortcuts[i]);
     }
+    CompileSettingsKeybindings(settings);
+    settings->triggers = g_ptr_array_new_with_free_func(FreeTrigger);
+    return settings;
+}
 
-    gtk_widget_destroy(dialog);
+Settings* CopySettings(const Settings* settings) {
+    Settings* copy = g_memdup2(settings, sizeof(Settings));
+    copy->font = g_strdup(settings->font);
+    copy->palette = g_strdup(settings->palette);
+    copy->word_chars = g_strdup(settings->word_chars);
+    copy->pipe_command = g_strdup(settings->pipe_command);
+    for (gint i = 0; i < SHORTCUT_COUNT; i++) {
+        copy->shortcuts[i] = g_strdup(settings->shortcuts[i]);
+    }
+    copy->keybindings = g_hash_table_ref(settings->keybindings);
+    copy->triggers = g_ptr_array_ref(settings->triggers);
+    copy->trigger_regex = settings->trigger_regex != NULL ? g_regex_ref(settings->trigger_regex) : NULL;
+    copy->trigger_literals = settings->trigger_literals != NULL ? g_regex_ref(settings->trigger_literals) : NULL;
+    return copy;
 }
 
-void PreviousTab(void) {
-    g_print("PreviousTab\n");
+void FreeSettings(Settings* settings) {
+    if (settings == NULL) {
+        return;
+    }
+    g_free(settings->font);
+    g_free(settings->palette);
+    g_free(settings->word_chars);
+    g_free(settings->pipe_command);
+    for (gint i = 0; i < SHORTCUT_COUNT; i++) {
+        g_free(settings->shortcuts[i]);
+    }
+    g_clear_pointer(&settings->keybindings, g_hash_table_unref);
+    g_ptr_array_unref(settings->triggers);
+    if (settings->trigger_regex != NULL) {
+        g_regex_unref(settings->trigger_regex);
+    }
+    if (settings->trigger_literals != NULL) {
+        g_regex_unref(settings->trigger_literals);
+    }
+    g_free(settings);
 }
 
-void NextTab(void) {
-    g_print("NextTab\n");
+const Palette* FindPalette(const gchar* id) {
+    for (gint i = 0; id != NULL && i < G_N_ELEMENTS(Palettes); i++) {
+        if (strcmp(Palettes[i].id, id) == 0) {
+            return &Palettes[i];
+        }
+    }
+    return NULL;
 }
 
-void MoveTabLeft(void) {
-    g_print("MoveTabLeft\n");
+const GdkRGBA* GetPaletteColors(const Settings* settings) {
+    const Palette* palette = FindPalette(settings->palette);
+    return palette != NULL ? palette->colors : settings->custom_palette;
 }
 
-void MoveTabRight(void) {
-    g_print("MoveTabRight\n");
+gboolean ColorsChanged(const Settings* old, const Settings* new) {
+    return old == NULL ||
+           !gdk_rgba_equal(&old->foreground, &new->foreground) ||
+           !gdk_rgba_equal(&old->background, &new->background) ||
+           memcmp(GetPaletteColors(old), GetPaletteColors(new), sizeof(GdkRGBA) * PALETTE_SIZE) != 0;
 }
 
-void CloseTab(void) {
-    g_print("CloseTab\n");
+gchar* GetSettingsPath(void) {
+    return g_build_filename(g_get_user_config_dir(), "illumiterm", "illumiterm.conf", NULL);
 }
 
-int NumTabs = 0;
+void ReadBoolean(GKeyFile* file, const gchar* group, const gchar* key, gboolean* value) {
+    GError* error = NULL;
+    gboolean result = g_key_file_get_boolean(file, group, key, &error);
+    if (error == NULL) {
+        *value = result;
+    } else {
+        g_error_free(error);
+    }
+}
 
-void UpdateNumTabs(GtkWidget* TabContainer) {
-    GList* children = gtk_container_get_children(GTK_CONTAINER(TabContainer));
-    NumTabs = g_list_length(children);
-    g_list_free(children);
+void ReadInteger(GKeyFile* file, const gchar* group, const gchar* key, glong* value) {
+    GError* error = NULL;
+    gint64 result = g_key_file_get_int64(file, group, key, &error);
+    if (error == NULL) {
+        *value = result;
+    } else {
+        g_error_free(error);
+    }
 }
 
-gboolean ConfirmExit(GtkWidget* widget, GdkEvent* event, gpointer data) {
-    GtkWidget* TabContainer = GTK_WIDGET(data);
-    UpdateNumTabs(TabContainer);
+void ReadString(GKeyFile* file, const gchar* group, const gchar* key, gchar** value) {
+    gchar* result = g_key_file_get_string(file, group, key, NULL);
+    if (result != NULL) {
+        g_free(*value);
+        *value = result;
+    }
+}
 
-    gchar* message = g_strdup_printf("You are about to close %d tabs. Are you sure you want to continue?", NumTabs);
-    GtkWidget* dialog = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_QUESTION, GTK_BUTTONS_YES_NO, "%s", message);
+void ReadColor(GKeyFile* file, const gchar* group, const gchar* key, GdkRGBA* value) {
+    gchar* result = g_key_file_get_string(file, group, key, NULL);
+    GdkRGBA color;
+    if (result != NULL && gdk_rgba_parse(&color, result)) {
+        *value = color;
+    }
+    g_free(result);
+}
 
-    gtk_window_set_title(GTK_WINDOW(dialog), "Confirm Close");
-    gtk_window_set_deletable(GTK_WINDOW(dialog), FALSE);
+gint GetTabPositionIndex(GtkPositionType position) {
+    for (gint i = 0; i < G_N_ELEMENTS(TabPositions); i++) {
+        if (TabPositions[i] == position) {
+            return i;
+        }
+    }
+    return 0;
+}
 
-    g_free(message);
+gint ReadAccessibility(GKeyFile* file) {
+    gint accessibility = ACCESSIBILITY_AUTO;
+    gchar* text = g_key_file_get_string(file, "Advanced", "Accessibility", NULL);
+    for (gint i = 0; text != NULL && i < G_N_ELEMENTS(AccessibilityNames); i++) {
+        if (g_strcmp0(text, AccessibilityNames[i]) == 0) {
+            accessibility = i;
+        }
+    }
+    g_free(text);
+    return accessibility;
+}
 
-    gtk_window_set_icon_from_file(GTK_WINDOW(dialog), "/usr/share/icons/hicolor/48x48/apps/illumiterm.png", NULL);
+Settings* LoadSettings(void) {
+    Settings* settings = DefaultSettings();
+    gchar* path = GetSettingsPath();
+    GKeyFile* file = g_key_file_new();
+    GError* error = NULL;
+
+    SettingsUnreadable = FALSE;
+    if (!g_key_file_load_from_file(file, path, G_KEY_FILE_NONE, &error)) {
+        if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            g_printerr("Failed to load %s: %s\n", path, error->message);
+            FreeSettings(settings);
+            settings = NULL;
+            SettingsUnreadable = TRUE;
+        }
+        g_error_free(error);
+    } else {
+        glong value;
+        gchar* text = NULL;
+
+        ReadString(file, "Style", "Font", &settings->font);
+        ReadColor(file, "Style", "Foreground", &settings->foreground);
+        ReadColor(file, "Style", "Background", &settings->background);
+        ReadString(file, "Style", "Palette", &settings->palette);
+        gchar** colors = g_key_file_get_string_list(file, "Style", "CustomPalette", NULL, NULL);
+        for (gint i = 0; colors != NULL && colors[i] != NULL && i < PALETTE_SIZE; i++) {
+            gdk_rgba_parse(&settings->custom_palette[i], colors[i]);
+        }
+        g_strfreev(colors);
+        value = settings->cursor_blink_time;
+        ReadInteger(file, "Style", "CursorBlinkTime", &value);
+        settings->cursor_blink_time = CLAMP(value, 100, 5000);
+        value = settings->cursor_blink_timeout;
+        ReadInteger(file, "Style", "CursorBlinkTimeout", &value);
+        settings->cursor_blink_timeout = CLAMP(value, 1, 3600);
+        ReadBoolean(file, "Style", "AllowBold", &settings->allow_bold);
+        ReadBoolean(file, "Style", "BoldIsBright", &settings->bold_is_bright);
+        ReadBoolean(file, "Style", "CursorBlink", &settings->cursor_blink);
+        ReadString(file, "Style", "CursorShape", &text);
+        if (g_strcmp0(text, "underline") == 0) {
+            settings->cursor_shape = VTE_CURSOR_SHAPE_UNDERLINE;
+        }
+        g_clear_pointer(&text, g_free);
+        ReadBoolean(file, "Style", "AudibleBell", &settings->audible_bell);
 
-    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
-    gtk_widget_destroy(dialog);
+        ReadString(file, "Display", "TabPosition", &text);
+        for (gint i = 0; text != NULL && i < G_N_ELEMENTS(TabPositionNames); i++) {
+            if (g_strcmp0(text, TabPositionNames[i]) == 0) {
+                settings->tab_position = TabPositions[i];
+            }
+        }
+        g_clear_pointer(&text, g_free);
+        ReadInteger(file, "Display", "Columns", &settings->columns);
+        ReadInteger(file, "Display", "Rows", &settings->rows);
+        settings->columns = CLAMP(settings->columns, 1, 1000);
+        settings->rows = CLAMP(settings->rows, 1, 1000);
+        ReadInteger(file, "Display", "Scrollback", &settings->scrollback);
+        settings->scrollback = MAX(settings->scrollback, -1);
+        ReadBoolean(file, "Display", "HideScrollbar", &settings->hide_scrollbar);
+        ReadBoolean(file, "Display", "HideMenuBar", &settings->hide_menu_bar);
+        ReadBoolean(file, "Display", "HideMousePointer", &settings->hide_mouse_pointer);
+
+        ReadString(file, "Advanced", "WordChars", &settings->word_chars);
+        ReadString(file, "Advanced", "PipeCommand", &settings->pipe_command);
+        ReadBoolean(file, "Advanced", "DisableMenuKey", &settings->disable_menu_key);
+        ReadBoolean(file, "Advanced", "DisableConfirm", &settings->disable_confirm);
+        ReadInteger(file, "Advanced", "SilenceSeconds", &settings->silence_seconds);
+        settings->silence_seconds = MAX(settings->silence_seconds, 0);
+        ReadBoolean(file, "Advanced", "NotifyTabs", &settings->notify_tabs);
+        ReadBoolean(file, "Advanced", "ExportMetrics", &settings->export_metrics);
+        ReadBoolean(file, "Advanced", "ArchiveScrollback", &settings->archive_scrollback);
+        ReadBoolean(file, "Advanced", "KeepScrollbackArchive", &settings->keep_archive);
+        ReadBoolean(file, "Advanced", "InlineImages", &settings->inline_images);
+        ReadInteger(file, "Advanced", "ImageMemory", &settings->image_memory);
+        settings->image_memory = MAX(settings->image_memory, 1);
+        ReadInteger(file, "Advanced", "WindowProcesses", &settings->window_processes);
+        settings->window_processes = CLAMP(settings->window_processes, 1, WINDOW_PROCESSES_MAX);
+        settings->accessibility = ReadAccessibility(file);
+
+        for (gint i = 0; i < SHORTCUT_COUNT; i++) {
+            ReadString(file, "Shortcuts", ShortcutNames[i], &settings->shortcuts[i]);
+        }
+        CompileSettingsKeybindings(settings);
 
-    return (response == GTK_RESPONSE_NO) ? TRUE : FALSE;
-}
+        ReadTriggers(file, settings);
+        CompileTriggers(settings);
+    }
 
-GtkWidget* ContextMenuHelper(GtkWidget* menu, const gchar* imagePath, const gchar* labelText, GCallback callback) {
-    GtkWidget *item, *box, *icon, *label;
-    
-    item = gtk_menu_item_new();
-    box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
-    icon = gtk_image_new_from_file(imagePath);
-    label = gtk_label_new(labelText);
-    
-    GtkWidget* spacing = gtk_label_new("  ");
-    
-    gtk_box_pack_start(GTK_BOX(box), icon, FALSE, FALSE, 0);
-    gtk_box_pack_start(GTK_BOX(box), spacing, FALSE, FALSE, 0);
-    gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
-    gtk_container_add(GTK_CONTAINER(item), box);
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu), item);
-    g_signal_connect(item, "activate", callback, NULL);
+    g_key_file_free(file);
+    g_free(path);
 
-    return item;
+    return settings;
 }
 
-GtkWidget* ContextMenu() {
-    GtkWidget *menu = gtk_menu_new();
-    GtkWidget *separator;
+void SaveSettings(const Settings* settings) {
+    GKeyFile* file = g_key_file_new();
+    gchar* path = GetSettingsPath();
+    gchar* directory = g_path_get_dirname(path);
+    gchar* color;
+    GError* error = NULL;
+
+    g_key_file_set_string(file, "Style", "Font", settings->font);
+    color = gdk_rgba_to_string(&settings->foreground);
+    g_key_file_set_string(file, "Style", "Foreground", color);
+    g_free(color);
+    color = gdk_rgba_to_string(&settings->background);
+    g_key_file_set_string(file, "Style", "Background", color);
+    g_free(color);
+    g_key_file_set_string(file, "Style", "Palette", settings->palette);
+    gchar* colors[PALETTE_SIZE];
+    for (gint i = 0; i < PALETTE_SIZE; i++) {
+        colors[i] = gdk_rgba_to_string(&settings->custom_palette[i]);
+    }
+    g_key_file_set_string_list(file, "Style", "CustomPalette", (const gchar* const*) colors, PALETTE_SIZE);
+    for (gint i = 0; i < PALETTE_SIZE; i++) {
+        g_free(colors[i]);
+    }
+    g_key_file_set_int64(file, "Style", "CursorBlinkTime", settings->cursor_blink_time);
+    g_key_file_set_int64(file, "Style", "CursorBlinkTimeout", settings->cursor_blink_timeout);
+    g_key_file_set_boolean(file, "Style", "AllowBold", settings->allow_bold);
+    g_key_file_set_boolean(file, "Style", "BoldIsBright", settings->bold_is_bright);
+    g_key_file_set_boolean(file, "Style", "CursorBlink", settings->cursor_blink);
+    g_key_file_set_string(file, "Style", "CursorShape",
+                          settings->cursor_shape == VTE_CURSOR_SHAPE_UNDERLINE ? "underline" : "block");
+    g_key_file_set_boolean(file, "Style", "AudibleBell", settings->audible_bell);
+
+    g_key_file_set_string(file, "Display", "TabPosition", TabPositionNames[GetTabPositionIndex(settings->tab_position)]);
+    g_key_file_set_int64(file, "Display", "Columns", settings->columns);
+    g_key_file_set_int64(file, "Display", "Rows", settings->rows);
+    g_key_file_set_int64(file, "Display", "Scrollback", settings->scrollback);
+    g_key_file_set_boolean(file, "Display", "HideScrollbar", settings->hide_scrollbar);
+    g_key_file_set_boolean(file, "Display", "HideMenuBar", settings->hide_menu_bar);
+    g_key_file_set_boolean(file, "Display", "HideMousePointer", settings->hide_mouse_pointer);
+
+    g_key_file_set_string(file, "Advanced", "WordChars", settings->word_chars);
+    g_key_file_set_string(file, "Advanced", "PipeCommand", settings->pipe_command);
+    g_key_file_set_boolean(file, "Advanced", "DisableMenuKey", settings->disable_menu_key);
+    g_key_file_set_boolean(file, "Advanced", "DisableConfirm", settings->disable_confirm);
+    g_key_file_set_int64(file, "Advanced", "SilenceSeconds", settings->silence_seconds);
+    g_key_file_set_boolean(file, "Advanced", "NotifyTabs", settings->notify_tabs);
+    g_key_file_set_boolean(file, "Advanced", "ExportMetrics", settings->export_metrics);
+    g_key_file_set_boolean(file, "Advanced", "ArchiveScrollback", settings->archive_scrollback);
+    g_key_file_set_boolean(file, "Advanced", "KeepScrollbackArchive", settings->keep_archive);
+    g_key_file_set_boolean(file, "Advanced", "InlineImages", settings->inline_images);
+    g_key_file_set_int64(file, "Advanced", "ImageMemory", settings->image_memory);
+    g_key_file_set_int64(file, "Advanced", "WindowProcesses", settings->window_processes);
+    g_key_file_set_string(file, "Advanced", "Accessibility", AccessibilityNames[settings->accessibility]);
+    for (gint i = 0; i < SHORTCUT_COUNT; i++) {
+        g_key_file_set_string(file, "Shortcuts", ShortcutNames[i], settings->shortcuts[i]);
+    }
+    WriteTriggers(file, settings);
+
+    g_mkdir_with_parents(directory, 0700);
+    if (SettingsUnreadable) {
+        // Keep the file that failed to load instead of replacing it with defaults.
+        gchar* backup = g_strconcat(path, ".bak", NULL);
+        if (g_rename(path, backup) == 0) {
+            g_printerr("Moved unreadable %s to %s\n", path, backup);
+            SettingsUnreadable = FALSE;
+        } else if (errno == ENOENT) {
+            SettingsUnreadable = FALSE;
+        } else {
+            g_printerr("Not saving %s: failed to back it up to %s: %s\n", path, backup, g_strerror(errno));
+        }
+        g_free(backup);
+    }
+    if (!SettingsUnreadable && !g_key_file_save_to_file(file, path, &error)) {
+        g_printerr("Failed to save %s: %s\n", path, error->message);
+        g_error_free(error);
+    }
 
-    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/window-new.svg", "New Window", G_CALLBACK(NewWindow));
-    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/tab-new.svg", "New Tab", G_CALLBACK(NewTab));
+    g_free(directory);
+    g_free(path);
+    g_key_file_free(file);
+}
 
-    separator = gtk_separator_menu_item_new();
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator);
+void ApplyGlobalSettings(const Settings* old, const Settings* new) {
+    if (old == NULL || old->export_metrics != new->export_metrics) {
+        SetMetricsExport(new->export_metrics);
+    }
+    GtkSettings* gtk_settings = gtk_settings_get_default();
+    if (gtk_settings == NULL) {
+        return;
+    }
+    if (old == NULL || old->cursor_blink_time != new->cursor_blink_time) {
+        g_object_set(gtk_settings, "gtk-cursor-blink-time", new->cursor_blink_time, NULL);
+    }
+    if (old == NULL || old->cursor_blink_timeout != new->cursor_blink_timeout) {
+        g_object_set(gtk_settings, "gtk-cursor-blink-timeout", new->cursor_blink_timeout, NULL);
+    }
+    if (old == NULL || old->disable_menu_key != new->disable_menu_key) {
+        g_object_set(gtk_settings, "gtk-menu-bar-accel", new->disable_menu_key ? "" : "F10", NULL);
+    }
+}
 
-    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/edit-copy.svg", "Copy", G_CALLBACK(Copy));
-    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/edit-paste.svg", "Paste", G_CALLBACK(Paste));
+void UpdateMenuBar(GtkWidget* window);
 
-    separator = gtk_separator_menu_item_new();
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator);
+void ApplyTerminalSettings(TerminalState* state, const Settings* old, const Settings* new) {
+    VteTerminal* terminal = VTE_TERMINAL(state->terminal);
 
-    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/edit-clear.svg", "Clear Scrollback", G_CALLBACK(ClearScrollback));
-    
-    separator = gtk_separator_menu_item_new();
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator);
-    
-    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/edit.svg", "Name Tab", G_CALLBACK(NameTab));
+    if (old == NULL || g_strcmp0(old->font, new->font) != 0) {
+        PangoFontDescription* font = pango_font_description_from_string(new->font);
+        BeginResize(state);
+        vte_terminal_set_font(terminal, font);
+        pango_font_description_free(font);
+    }
+    if (ColorsChanged(old, new)) {
+        vte_terminal_set_colors(terminal, &new->foreground, &new->background, GetPaletteColors(new), PALETTE_SIZE);
+        if (old != NULL && gtk_widget_get_mapped(state->terminal)) {
+            g_signal_connect_after(state->terminal, "draw", G_CALLBACK(PaletteDrawn), NULL);
+            PalettePendingDraws++;
+        }
+    }
+    if (old == NULL || old->allow_bold != new->allow_bold) {
+        g_object_set(terminal, "allow-bold", new->allow_bold, NULL);
+    }
+    if (old == NULL || old->bold_is_bright != new->bold_is_bright) {
+        vte_terminal_set_bold_is_bright(terminal, new->bold_is_bright);
+    }
+    if (old == NULL || old->cursor_blink != new->cursor_blink) {
+        UpdateCursorBlink(state, new);
+    }
+    if (old == NULL || old->cursor_shape != new->cursor_shape) {
+        vte_terminal_set_cursor_shape(terminal, new->cursor_shape);
+    }
+    if (old == NULL || old->audible_bell != new->audible_bell) {
+        vte_terminal_set_audible_bell(terminal, new->audible_bell);
+    }
+#if VTE_CHECK_VERSION(0, 62, 0)
+    if (old == NULL || old->inline_images != new->inline_images) {
+        state->images = new->inline_images && (vte_get_feature_flags() & VTE_FEATURE_FLAG_SIXEL) != 0;
+        state->image_scan = IMAGE_SCAN_TEXT;
+        state->image_dropped = FALSE;
+        g_byte_array_set_size(state->image_held, 0);
+        state->image_current = NULL;
+        vte_terminal_set_enable_sixel(terminal, state->images);
+    }
+#endif
+    if (old == NULL || old->scrollback != new->scrollback || old->archive_scrollback != new->archive_scrollback) {
+        glong limit = new->archive_scrollback ? new->scrollback : 0;
+        UpdateArchive(state, limit);
+        vte_terminal_set_scrollback_lines(terminal, state->archive != NULL ? limit + ARCHIVE_MARGIN_ROWS : new->scrollback);
+    }
+    if (state->archive != NULL) {
+        g_atomic_int_set(&state->archive->keep, new->keep_archive);
+    }
+    if (old == NULL || old->hide_mouse_pointer != new->hide_mouse_pointer) {
+        vte_terminal_set_mouse_autohide(terminal, new->hide_mouse_pointer);
+    }
+    if (old == NULL || g_strcmp0(old->word_chars, new->word_chars) != 0) {
+        vte_terminal_set_word_char_exceptions(terminal, new->word_chars);
+    }
+    if (old != NULL && old->hide_menu_bar != new->hide_menu_bar) {
+        UpdateMenuBar(state->window);
+    }
+    if (old == NULL || old->hide_scrollbar != new->hide_scrollbar) {
+        GtkWidget* scrolled_window = gtk_widget_get_ancestor(state->terminal, GTK_TYPE_SCROLLED_WINDOW);
+        if (scrolled_window != NULL) {
+            gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC,
+                                           new->hide_scrollbar ? GTK_POLICY_EXTERNAL : GTK_POLICY_ALWAYS);
+        }
+    }
+    if (old == NULL || old->tab_position != new->tab_position) {
+        GtkWidget* notebook = gtk_widget_get_ancestor(state->terminal, GTK_TYPE_NOTEBOOK);
+        if (notebook != NULL) {
+            gtk_notebook_set_tab_pos(GTK_NOTEBOOK(notebook), new->tab_position);
+        }
+    }
+    if (old == NULL || old->triggers != new->triggers) {
+        for (guint i = 0; i < state->trigger_tags->len; i++) {
+            vte_terminal_match_remove(terminal, g_array_index(state->trigger_tags, gint, i));
+        }
+        g_array_set_size(state->trigger_tags, 0);
+        for (guint i = 0; i < new->triggers->len; i++) {
+            Trigger* trigger = g_ptr_array_index(new->triggers, i);
+            if (trigger->highlight != NULL) {
+                gint tag = vte_terminal_match_add_regex(terminal, trigger->highlight, 0);
+                vte_terminal_match_set_cursor_name(terminal, tag, "pointer");
+                g_array_append_val(state->trigger_tags, tag);
+            }
+        }
+    }
+    if (old != NULL && (!gdk_rgba_equal(&old->foreground, &new->foreground) || !gdk_rgba_equal(&old->background, &new->background))) {
+        InvalidateThumbnail(state);
+    }
+    if (old == NULL) {
+        vte_terminal_set_size(terminal, new->columns, new->rows);
+    }
+}
 
-    separator = gtk_separator_menu_item_new();
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator);
+void ReplaceSettings(Settings* settings) {
+    Settings* old = CurrentSettings;
+    gboolean recolor = old != NULL && ColorsChanged(old, settings);
+    CurrentSettings = settings;
 
-    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/go-previous.svg", "Previous Tab", G_CALLBACK(PreviousTab));
-    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/go-next.svg", "Next Tab", G_CALLBACK(NextTab));
-    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/go-up.svg", "Move Tab Left", G_CALLBACK(MoveTabLeft));
-    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/go-down.svg", "Move Tab Right", G_CALLBACK(MoveTabRight));
+    if (recolor) {
+        for (GList* item = Terminals; item != NULL; item = item->next) {
+            g_signal_handlers_disconnect_by_func(((TerminalState*) item->data)->terminal, PaletteDrawn, NULL);
+        }
+        PalettePendingDraws = 0;
+        PaletteSwitchStarted = g_get_monotonic_time();
+    }
 
-    separator = gtk_separator_menu_item_new();
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator);
+    ApplyGlobalSettings(old, settings);
+    for (GList* item = Terminals; item != NULL; item = item->next) {
+        ApplyTerminalSettings(item->data, old, settings);
+    }
+    FreeSettings(old);
 
-    ContextMenuHelper(menu, "/usr/share/icons/hicolor/24x24/apps/window-close.svg", "Close Tab", G_CALLBACK(CloseTab));
+    if (recolor) {
+        PaletteSwitchApply = g_get_monotonic_time() - PaletteSwitchStarted;
+        PaletteSwitchTerminals = g_list_length(Terminals);
+        PaletteSwitchFrame = 0;
+    }
+}
 
-    gtk_widget_show_all(menu);
+void ToggleLightDark(void) {
+    Settings* settings = CopySettings(CurrentSettings);
+    const Palette* palette = FindPalette(settings->palette);
+    const Palette* counterpart = palette != NULL ? FindPalette(palette->counterpart) : NULL;
 
-    return menu;
+    if (counterpart != NULL) {
+        g_free(settings->palette);
+        settings->palette = g_strdup(counterpart->id);
+        settings->foreground = counterpart->foreground;
+        settings->background = counterpart->background;
+    } else {
+        GdkRGBA foreground = settings->foreground;
+        settings->foreground = settings->background;
+        settings->background = foreground;
+    }
+    SaveSettings(settings);
+    ReplaceSettings(settings);
 }
 
-gboolean ButtonPressEvent(GtkWidget *widget, GdkEventButton *event, gpointer data) {
-    if (event->button != GDK_BUTTON_SECONDARY) {
-        return FALSE;
+gboolean ReloadSettings(gpointer data) {
+    SettingsReloadSource = 0;
+    Settings* settings = LoadSettings();
+    if (settings != NULL) {
+        ReplaceSettings(settings);
     }
-    GtkWidget *menu = ContextMenu();
-    gtk_menu_popup_at_pointer(GTK_MENU(menu), NULL);
-
-    return TRUE;
+    return G_SOURCE_REMOVE;
 }
 
-void ChildReady(VteTerminal* terminal, GPid pid, GError* error, gpointer user_data) {
-    if (terminal == NULL) {
+void SettingsFileChanged(GFileMonitor* monitor, GFile* file, GFile* other, GFileMonitorEvent event, gpointer data) {
+    if (event == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED || event == G_FILE_MONITOR_EVENT_PRE_UNMOUNT) {
         return;
     }
-    if (pid == 0) {
-        GtkWidget* window = GTK_WIDGET(user_data);
-        gint error_code = (error != NULL) ? error->code : 0;
-        DestroyAndQuit(window, error_code);
+    if (SettingsReloadSource != 0) {
+        g_source_remove(SettingsReloadSource);
     }
+    SettingsReloadSource = g_timeout_add(SETTINGS_RELOAD_DELAY, ReloadSettings, NULL);
 }
 
-gchar** GetEnviroment(GApplicationCommandLine* cli) {
-    const gchar* const* environment = g_application_command_line_get_environ(cli);
+void InitSettings(void) {
+    Settings* settings = LoadSettings();
+    ReplaceSettings(settings != NULL ? settings : DefaultSettings());
 
-    guint num_variables = g_strv_length((gchar**)environment);
-    gchar** result = g_new0(gchar*, num_variables + 1);
+    gchar* path = GetSettingsPath();
+    GFile* file = g_file_new_for_path(path);
+    SettingsMonitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, NULL);
+    if (SettingsMonitor != NULL) {
+        g_signal_connect(SettingsMonitor, "changed", G_CALLBACK(SettingsFileChanged), NULL);
+    }
+    g_object_unref(file);
+    g_free(path);
+}
 
-    for (guint i = 0; i < num_variables; ++i) {
-        result[i] = g_strdup(environment[i]);
+void SetFontScale(TerminalState* state, gdouble scale) {
+    if (state == NULL) {
+        return;
     }
-    return result;
+    BeginResize(state);
+    vte_terminal_set_font_scale(VTE_TERMINAL(state->terminal), CLAMP(scale, ZOOM_MIN, ZOOM_MAX));
 }
 
 void ConnectSignal(GtkWidget* widget, const char* signal_name, GCallback callback, gpointer user_data) {
     g_signal_connect(widget, signal_name, callback, user_data);
 }
 
+gboolean CountFrame(GtkWidget* widget, cairo_t* cr, gpointer data) {
+    atomic_fetch_add_explicit(&MetricFrames, 1, memory_order_relaxed);
+    return FALSE;
+}
+
 void ConnectVteSignals(GtkWidget* widget, GtkWidget* window) {
+    ConnectSignal(widget, "draw", G_CALLBACK(CountFrame), NULL);
     ConnectSignal(widget, "child-exited", G_CALLBACK(ChildExited), window);
     ConnectSignal(widget, "window-title-changed", G_CALLBACK(WindowTitleChanged), window);
+    ConnectSignal(widget, "current-directory-uri-changed", G_CALLBACK(DirectoryChanged), NULL);
     ConnectSignal(widget, "button-press-event", G_CALLBACK(ButtonPressEvent), NULL);
-    ConnectSignal(window, "delete-event", G_CALLBACK(ConfirmExit), NULL);
+    ConnectSignal(widget, "hyperlink-hover-uri-changed", G_CALLBACK(HyperlinkHovered), NULL);
+    ConnectSignal(widget, "commit", G_CALLBACK(Commit), NULL);
+    ConnectSignal(widget, "contents-changed", G_CALLBACK(FeedProcessed), NULL);
+    ConnectSignal(widget, "cursor-moved", G_CALLBACK(FeedProcessed), NULL);
+    ConnectSignal(widget, "commit", G_CALLBACK(BroadcastTyped), NULL);
+    ConnectSignal(widget, "key-press-event", G_CALLBACK(BroadcastKeyPress), NULL);
+    ConnectSignal(widget, "focus-in-event", G_CALLBACK(TerminalFocused), NULL);
+    ConnectSignal(widget, "unmap", G_CALLBACK(TerminalUnmapped), NULL);
+    g_signal_connect_after(widget, "size-allocate", G_CALLBACK(UpdatePtySize), NULL);
 }
 
-void SpawnVteTerminal(GApplicationCommandLine* cli, GtkWidget* window, GtkWidget* widget) {
-    GVariantDict* options = g_application_command_line_get_options_dict(cli);
-    const gchar* command = NULL;
-    g_variant_dict_lookup(options, "cmd", "&s", &command);
+void SpawnVteTerminal(GApplicationCommandLine* cli, GtkWidget* window, GtkWidget* widget, const gchar* command, const gchar* directory, gint* input) {
     gchar** environment = GetEnviroment(cli);
     gchar** cmd;
     gchar* cmdline = NULL;
     cmd = command ?
-        (gchar*[]) {"/bin/sh", cmdline = g_strdup(command), NULL} :
+        (gchar*[]) {"/bin/sh", "-c", cmdline = g_strdup(command), NULL} :
         (gchar*[]) {cmdline = g_strdup(g_application_command_line_getenv(cli, "SHELL")), NULL};
 
     ConnectVteSignals(widget, window);
-
-    vte_terminal_set_word_char_exceptions(VTE_TERMINAL(widget), "-./?%&_=+@~:");
-    vte_terminal_set_scrollback_lines(VTE_TERMINAL(widget), -1);
+    RegisterTerminal(widget, window);
+    TerminalState* state = GetTerminalState(widget);
+    state->spawned_at = g_get_monotonic_time();
+    TraceLatency(state, LatencyTracing);
+    UpdateBroadcastIndicator(state);
+    AddLinkMatches(state);
+
+    ApplyTerminalSettings(state, NULL, CurrentSettings);
     vte_terminal_set_scroll_on_output(VTE_TERMINAL(widget), TRUE);
     vte_terminal_set_scroll_on_keystroke(VTE_TERMINAL(widget), TRUE);
-    vte_terminal_set_mouse_autohide(VTE_TERMINAL(widget), TRUE);
-    vte_terminal_set_bold_is_bright(VTE_TERMINAL(widget), TRUE);
-    vte_terminal_set_audible_bell(VTE_TERMINAL(widget), TRUE);
-    vte_terminal_set_cursor_blink_mode(VTE_TERMINAL(widget), TRUE);
-
-    vte_terminal_spawn_async(VTE_TERMINAL(widget),
-        VTE_PTY_DEFAULT,
-        g_application_command_line_get_cwd(cli),
-        cmd,
-        environment,
-        0,
-        NULL,
-        NULL,
-        NULL,
-        -1,
-        NULL,
-        ChildReady,
-        window);
+
+    GError* error = NULL;
+    state->pty = vte_pty_new_sync(VTE_PTY_DEFAULT, NULL, &error);
+
+    if (state->pty == NULL) {
+        ChildReady(VTE_TERMINAL(widget), 0, error, window);
+        g_error_free(error);
+    } else {
+        state->pty_rows = state->pending_rows = vte_terminal_get_row_count(VTE_TERMINAL(widget));
+        state->pty_columns = state->pending_columns = vte_terminal_get_column_count(VTE_TERMINAL(widget));
+        vte_pty_set_size(state->pty, state->pty_rows, state->pty_columns, NULL);
+        if (directory == NULL) {
+            directory = g_application_command_line_get_cwd(cli);
+        }
+
+        if (input != NULL) {
+            SpawnPiped(state, directory, cmd, environment, input);
+        } else {
+            vte_pty_spawn_async(state->pty,
+                directory,
+                cmd,
+                environment,
+                0,
+                NULL,
+                NULL,
+                NULL,
+                -1,
+                NULL,
+                PtySpawned,
+                g_object_ref(widget));
+        }
+    }
 
     g_strfreev(environment);
     g_free(cmdline);
@@ -362,9 +5321,7 @@ GtkWidget* FileMenuHelper(const gchar* iconPath, const gchar* label, const gchar
     return menuItem;
 }
 
-GtkWidget* FileMenu() {
-    GtkWidget* file_menu = gtk_menu_new();
-
+GtkWidget* FileMenu(GtkWidget* file_menu) {
     GtkWidget* new_window_item = FileMenuHelper("/usr/share/icons/hicolor/24x24/apps/window-new.svg", "New Window", "Shift+Ctrl+N", G_CALLBACK(NewWindow));
     gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), new_window_item);
 
@@ -385,49 +5342,50 @@ GtkWidget* FileMenu() {
 }
 
 void ZoomIn(void) {
-    g_print("ZoomIn\n");
+    TerminalState* state = GetActiveTerminalState();
+    if (state != NULL) {
+        SetFontScale(state, vte_terminal_get_font_scale(VTE_TERMINAL(state->terminal)) * ZOOM_STEP);
+    }
 }
 
 void ZoomOut(void) {
-    g_print("ZoomOut\n");
+    TerminalState* state = GetActiveTerminalState();
+    if (state != NULL) {
+        SetFontScale(state, vte_terminal_get_font_scale(VTE_TERMINAL(state->terminal)) / ZOOM_STEP);
+    }
 }
 
 void ZoomReset(void) {
-    g_print("ZoomReset\n");
+    SetFontScale(GetActiveTerminalState(), 1.0);
 }
 
-void palette_selected(void)
+void palette_selected(GtkComboBox *combo_box, gpointer user_data)
 {
-
+    const Palette *palette = FindPalette(gtk_combo_box_get_active_id(combo_box));
+    GtkWidget **buttons = g_object_get_data(G_OBJECT(user_data), "palette-buttons");
+    if (palette == NULL || buttons == NULL) {
+        return;
+    }
+    for (int i = 0; i < PALETTE_SIZE; i++) {
+        gtk_color_chooser_set_rgba(GTK_COLOR_CHOOSER(buttons[i]), &palette->colors[i]);
+    }
+    gtk_color_chooser_set_rgba(GTK_COLOR_CHOOSER(g_object_get_data(G_OBJECT(user_data), "foreground")), &palette->foreground);
+    gtk_color_chooser_set_rgba(GTK_COLOR_CHOOSER(g_object_get_data(G_OBJECT(user_data), "background")), &palette->background);
 }
 
-void color_selected(void)
+void color_selected(GtkColorButton *button, gpointer user_data)
 {
-
+    gtk_combo_box_set_active_id(GTK_COMBO_BOX(g_object_get_data(G_OBJECT(user_data), "palette")), "custom");
 }
 
 void OpenFontDialog(GtkWidget *widget, gpointer user_data) {
-    GtkComboBoxText *font_combo_box = GTK_COMBO_BOX_TEXT(user_data);
-
     GtkWidget *dialog = gtk_font_chooser_dialog_new("Select Font", GTK_WINDOW(gtk_widget_get_toplevel(widget)));
 
-    const gchar *current_font = gtk_combo_box_text_get_active_text(font_combo_box);
-
-    gtk_font_chooser_set_font(GTK_FONT_CHOOSER(dialog), current_font);
+    gtk_font_chooser_set_font(GTK_FONT_CHOOSER(dialog), gtk_button_get_label(GTK_BUTTON(widget)));
 
     if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_OK) {
         gchar *selected_font = gtk_font_chooser_get_font(GTK_FONT_CHOOSER(dialog));
-        GtkTreeIter iter;
-
-        if (gtk_combo_box_get_active_iter(GTK_COMBO_BOX(font_combo_box), &iter)) {
-            gchar *font_family_name;
-            gtk_tree_model_get(GTK_TREE_MODEL(font_combo_box), &iter, 0, &font_family_name, -1);
-
-            if (g_strcmp0(font_family_name, selected_font) == 0) {
-                gtk_combo_box_set_active_iter(GTK_COMBO_BOX(font_combo_box), &iter);
-            }
-            g_free(font_family_name);
-        }
+        gtk_button_set_label(GTK_BUTTON(widget), selected_font);
         g_free(selected_font);
     }
     gtk_widget_destroy(dialog);
@@ -445,10 +5403,9 @@ void StyleTab(GtkNotebook *notebook)
     gtk_label_set_xalign(GTK_LABEL(font_label), 0);
     gtk_grid_attach(GTK_GRID(style_grid), font_label, 0, 0, 1, 1);
 
-    GtkComboBoxText *font_combo_box = GTK_COMBO_BOX_TEXT(gtk_combo_box_text_new());
-
-    GtkWidget *font_button = gtk_button_new_with_label("Monospace Regular 10");
-    g_signal_connect(font_button, "clicked", G_CALLBACK(OpenFontDialog), font_combo_box);
+    GtkWidget *font_button = gtk_button_new_with_label(CurrentSettings->font);
+    g_signal_connect(font_button, "clicked", G_CALLBACK(OpenFontDialog), NULL);
+    g_object_set_data(G_OBJECT(notebook), "font", font_button);
     gtk_grid_attach(GTK_GRID(style_grid), font_button, 1, 0, 1, 1);
 
     GtkWidget *background_label = gtk_label_new("Background:");
@@ -456,10 +5413,8 @@ void StyleTab(GtkNotebook *notebook)
     gtk_label_set_xalign(GTK_LABEL(background_label), 0);
     gtk_grid_attach(GTK_GRID(style_grid), background_label, 0, 1, 1, 1);
 
-    GdkRGBA black_color;
-    gdk_rgba_parse(&black_color, "black");
-	
-    GtkWidget *background_color_button = gtk_color_button_new_with_rgba(&black_color);
+    GtkWidget *background_color_button = gtk_color_button_new_with_rgba(&CurrentSettings->background);
+    g_object_set_data(G_OBJECT(notebook), "background", background_color_button);
     gtk_widget_set_size_request(background_color_button, 100, -1);
     gtk_grid_attach(GTK_GRID(style_grid), background_color_button, 1, 1, 1, 1);
     
@@ -468,10 +5423,8 @@ void StyleTab(GtkNotebook *notebook)
     gtk_label_set_xalign(GTK_LABEL(foreground_label), 0);
     gtk_grid_attach(GTK_GRID(style_grid), foreground_label, 0, 2, 1, 1);
 
-    GdkRGBA gray_color;
-    gdk_rgba_parse(&gray_color, "gray");
-
-    GtkWidget *foreground_color_button = gtk_color_button_new_with_rgba(&gray_color);
+    GtkWidget *foreground_color_button = gtk_color_button_new_with_rgba(&CurrentSettings->foreground);
+    g_object_set_data(G_OBJECT(notebook), "foreground", foreground_color_button);
     gtk_widget_set_size_request(foreground_color_button, 100, -1);
     gtk_grid_attach(GTK_GRID(style_grid), foreground_color_button, 1, 2, 1, 1);
 
@@ -487,14 +5440,16 @@ void StyleTab(GtkNotebook *notebook)
     gtk_combo_box_text_append(palette_combo_box, "solarized-dark", "Solarized Dark");
     gtk_combo_box_text_append(palette_combo_box, "solarized-light", "Solarized Light");
     gtk_combo_box_text_append(palette_combo_box, "custom", "Custom");
-    gtk_combo_box_set_active_id(GTK_COMBO_BOX(palette_combo_box), "vga");
+    gtk_combo_box_set_active_id(GTK_COMBO_BOX(palette_combo_box), CurrentSettings->palette);
+    g_object_set_data(G_OBJECT(notebook), "palette", palette_combo_box);
 
-    g_signal_connect(palette_combo_box, "changed", G_CALLBACK(palette_selected), NULL);
+    g_signal_connect(palette_combo_box, "changed", G_CALLBACK(palette_selected), notebook);
     gtk_grid_attach(GTK_GRID(style_grid), GTK_WIDGET(palette_combo_box), 1, 3, 1, 1);
 
-    const char *color_names[] = {"Black", "Red", "Green", "Brown", "Blue", "Magenta", "Cyan", "Gray"};
-    GdkRGBA colors[] = {{0, 0, 0, 1}, {1, 0, 0, 1}, {0, 1, 0, 1}, {0.6, 0.4, 0.2, 1}, {0, 0, 1, 1}, {1, 0, 1, 1}, {0, 1, 1, 1}, {0.5, 0.5, 0.5, 1}};
-    int num_colors = sizeof(color_names) / sizeof(color_names[0]);
+    const GdkRGBA *colors = GetPaletteColors(CurrentSettings);
+    GtkWidget **palette_buttons = g_new(GtkWidget *, PALETTE_SIZE);
+    g_object_set_data_full(G_OBJECT(notebook), "palette-buttons", palette_buttons, g_free);
+    int num_colors = PALETTE_SIZE / 2;
     int color_button_width = 85;
 
     GtkWidget *color_button_box = gtk_button_box_new(GTK_ORIENTATION_HORIZONTAL);
@@ -505,22 +5460,22 @@ void StyleTab(GtkNotebook *notebook)
         GtkWidget *color_button = gtk_color_button_new_with_rgba(&colors[i]);
         gtk_widget_set_size_request(color_button, color_button_width, -1);
         gtk_container_add(GTK_CONTAINER(color_button_box), color_button);
-        g_signal_connect(color_button, "color-set", G_CALLBACK(color_selected), NULL);
+        g_signal_connect(color_button, "color-set", G_CALLBACK(color_selected), notebook);
+        palette_buttons[i] = color_button;
     }
 
-    const char *additional_color_names[] = {"Light Gray", "Bright Red", "Bright Green", "Yellow", "Bright Blue", "Bright Magenta", "Bright Cyan", "White"};
-    GdkRGBA additional_colors[] = {{0.9, 0.9, 0.9, 1}, {1, 0.5, 0.5, 1}, {0.5, 1, 0.5, 1}, {1, 1, 0.8, 1}, {0.5, 0.5, 1, 1}, {1, 0.5, 1, 1}, {0.5, 1, 1, 1}, {1, 1, 1, 1}};
-    int num_additional_colors = sizeof(additional_color_names) / sizeof(additional_color_names[0]);
+    int num_additional_colors = PALETTE_SIZE - num_colors;
 
     GtkWidget *additional_color_button_box = gtk_button_box_new(GTK_ORIENTATION_HORIZONTAL);
     gtk_button_box_set_layout(GTK_BUTTON_BOX(additional_color_button_box), GTK_BUTTONBOX_CENTER);
     gtk_grid_attach(GTK_GRID(style_grid), additional_color_button_box, 0, 5, num_additional_colors, 1);
 
     for (int i = 0; i < num_additional_colors; i++) {
-        GtkWidget *additional_color_button = gtk_color_button_new_with_rgba(&additional_colors[i]);
+        GtkWidget *additional_color_button = gtk_color_button_new_with_rgba(&colors[num_colors + i]);
         gtk_widget_set_size_request(additional_color_button, color_button_width, -1);
         gtk_container_add(GTK_CONTAINER(additional_color_button_box), additional_color_button);
-        g_signal_connect(additional_color_button, "color-set", G_CALLBACK(color_selected), NULL);
+        g_signal_connect(additional_color_button, "color-set", G_CALLBACK(color_selected), notebook);
+        palette_buttons[num_colors + i] = additional_color_button;
     }
 
     GtkWidget *cursor_blink_time_label = gtk_label_new("Cursor Blink Time (ms):");
@@ -528,8 +5483,9 @@ void StyleTab(GtkNotebook *notebook)
     gtk_label_set_xalign(GTK_LABEL(cursor_blink_time_label), 0);
     gtk_grid_attach(GTK_GRID(style_grid), cursor_blink_time_label, 0, 6, 1, 1);
 
-    GtkAdjustment *cursor_blink_time_adjustment = gtk_adjustment_new(500, 100, 5000, 100, 100, 0);
+    GtkAdjustment *cursor_blink_time_adjustment = gtk_adjustment_new(CurrentSettings->cursor_blink_time, 100, 5000, 100, 100, 0);
     GtkWidget *cursor_blink_time_spin = gtk_spin_button_new(cursor_blink_time_adjustment, 1, 0);
+    g_object_set_data(G_OBJECT(notebook), "cursor-blink-time", cursor_blink_time_spin);
     gtk_grid_attach(GTK_GRID(style_grid), cursor_blink_time_spin, 1, 6, 1, 1);
     gtk_widget_set_size_request(cursor_blink_time_spin, 100, -1);
     
@@ -539,7 +5495,8 @@ void StyleTab(GtkNotebook *notebook)
     gtk_grid_attach(GTK_GRID(style_grid), allow_bold_font_label, 0, 7, 1, 1);
 
     GtkWidget *allow_bold_font_check = gtk_check_button_new();
-    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(allow_bold_font_check), TRUE);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(allow_bold_font_check), CurrentSettings->allow_bold);
+    g_object_set_data(G_OBJECT(notebook), "allow-bold", allow_bold_font_check);
     gtk_grid_attach(GTK_GRID(style_grid), allow_bold_font_check, 1, 7, 1, 1);
     
     GtkWidget *bold_is_bright_label = gtk_label_new("Bold is Bright:");
@@ -553,11 +5510,13 @@ void StyleTab(GtkNotebook *notebook)
     gtk_grid_attach(GTK_GRID(style_grid), cursor_blink_label, 0, 9, 1, 1);
 
     GtkWidget *cursor_blink_check = gtk_check_button_new();
-    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(cursor_blink_check), FALSE);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(cursor_blink_check), CurrentSettings->cursor_blink);
+    g_object_set_data(G_OBJECT(notebook), "cursor-blink", cursor_blink_check);
     gtk_grid_attach(GTK_GRID(style_grid), cursor_blink_check, 1, 9, 1, 1);
 
     GtkWidget *bold_is_bright_check = gtk_check_button_new();
-    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(bold_is_bright_check), FALSE);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(bold_is_bright_check), CurrentSettings->bold_is_bright);
+    g_object_set_data(G_OBJECT(notebook), "bold-is-bright", bold_is_bright_check);
     gtk_grid_attach(GTK_GRID(style_grid), bold_is_bright_check, 1, 8, 1, 1);
     
     GtkWidget *cursor_style_label = gtk_label_new("Cursor Style:");
@@ -574,6 +5533,8 @@ void StyleTab(GtkNotebook *notebook)
     GtkWidget *underline_cursor_radio = gtk_radio_button_new_with_label_from_widget(GTK_RADIO_BUTTON(block_cursor_radio), "Underline");
     gtk_box_pack_start(GTK_BOX(radio_button_box), underline_cursor_radio, FALSE, FALSE, 0);
     gtk_grid_attach(GTK_GRID(style_grid), underline_cursor_radio, 1, 11, 1, 1);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(underline_cursor_radio), CurrentSettings->cursor_shape == VTE_CURSOR_SHAPE_UNDERLINE);
+    g_object_set_data(G_OBJECT(notebook), "underline-cursor", underline_cursor_radio);
 
     GtkWidget *audible_bell_label = gtk_label_new("Audible Bell:");
     gtk_label_set_use_markup(GTK_LABEL(audible_bell_label), TRUE);
@@ -581,7 +5542,8 @@ void StyleTab(GtkNotebook *notebook)
     gtk_grid_attach(GTK_GRID(style_grid), audible_bell_label, 0, 11, 1, 1);
 
     GtkWidget *audible_bell_check = gtk_check_button_new();
-    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(audible_bell_check), FALSE);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(audible_bell_check), CurrentSettings->audible_bell);
+    g_object_set_data(G_OBJECT(notebook), "audible-bell", audible_bell_check);
     gtk_grid_attach(GTK_GRID(style_grid), audible_bell_check, 1, 11, 1, 1);
 
     GtkWidget *visual_bell_label = gtk_label_new("Visual Bell:");
@@ -592,6 +5554,15 @@ void StyleTab(GtkNotebook *notebook)
     GtkWidget *visual_bell_check = gtk_check_button_new();
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(visual_bell_check), FALSE);
     gtk_grid_attach(GTK_GRID(style_grid), visual_bell_check, 1, 12, 1, 1);
+
+    GtkWidget *cursor_blink_timeout_label = gtk_label_new("Stop Blinking After Idle (s):");
+    gtk_label_set_xalign(GTK_LABEL(cursor_blink_timeout_label), 0);
+    gtk_grid_attach(GTK_GRID(style_grid), cursor_blink_timeout_label, 0, 13, 1, 1);
+
+    GtkAdjustment *cursor_blink_timeout_adjustment = gtk_adjustment_new(CurrentSettings->cursor_blink_timeout, 1, 3600, 1, 10, 0);
+    GtkWidget *cursor_blink_timeout_spin = gtk_spin_button_new(cursor_blink_timeout_adjustment, 1, 0);
+    g_object_set_data(G_OBJECT(notebook), "cursor-blink-timeout", cursor_blink_timeout_spin);
+    gtk_grid_attach(GTK_GRID(style_grid), cursor_blink_timeout_spin, 1, 13, 1, 1);
     gtk_notebook_append_page(notebook, style_grid, style_tab);
 }
 
@@ -610,7 +5581,8 @@ void DisplayTab(GtkNotebook *notebook) {
     gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(tab_position_combo), "Bottom");
     gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(tab_position_combo), "Left");
     gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(tab_position_combo), "Right");
-    gtk_combo_box_set_active(GTK_COMBO_BOX(tab_position_combo), 0);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(tab_position_combo), GetTabPositionIndex(CurrentSettings->tab_position));
+    g_object_set_data(G_OBJECT(notebook), "tab-position", tab_position_combo);
     gtk_grid_attach(GTK_GRID(display_grid), tab_position_combo, 1, 0, 1, 1);
 
     GtkWidget *default_size_label = gtk_label_new("Default window size:");
@@ -618,8 +5590,9 @@ void DisplayTab(GtkNotebook *notebook) {
 
     GtkWidget *style_grid = gtk_grid_new();
 
-    GtkAdjustment *width_adjustment = gtk_adjustment_new(80, 1, 1000, 1, 100, 0);
+    GtkAdjustment *width_adjustment = gtk_adjustment_new(CurrentSettings->columns, 1, 1000, 1, 100, 0);
     GtkWidget *width_spin = gtk_spin_button_new(width_adjustment, 1, 0);
+    g_object_set_data(G_OBJECT(notebook), "columns", width_spin);
     gtk_widget_set_size_request(width_spin, 292, -1);
     gtk_grid_attach(GTK_GRID(style_grid), width_spin, 0, 0, 1, 1);
 
@@ -627,8 +5600,9 @@ void DisplayTab(GtkNotebook *notebook) {
     gtk_widget_set_halign(x_label, GTK_ALIGN_CENTER);
     gtk_grid_attach(GTK_GRID(style_grid), x_label, 1, 0, 1, 1);
 
-    GtkAdjustment *height_adjustment = gtk_adjustment_new(24, 1, 1000, 1, 100, 0);
+    GtkAdjustment *height_adjustment = gtk_adjustment_new(CurrentSettings->rows, 1, 1000, 1, 100, 0);
     GtkWidget *height_spin = gtk_spin_button_new(height_adjustment, 1, 0);
+    g_object_set_data(G_OBJECT(notebook), "rows", height_spin);
     gtk_widget_set_size_request(height_spin, 100, -1);
     gtk_grid_attach(GTK_GRID(style_grid), height_spin, 2, 0, 1, 1);
 
@@ -637,9 +5611,11 @@ void DisplayTab(GtkNotebook *notebook) {
 
     GtkWidget *scrollback_label = gtk_label_new("Scrollback Lines:");
     gtk_grid_attach(GTK_GRID(display_grid), scrollback_label, 0, 1, 1, 1);
-    GtkAdjustment *scrollback_adjustment = gtk_adjustment_new(1000, 1, 10000, 1, 100, 0);
+    GtkAdjustment *scrollback_adjustment = gtk_adjustment_new(CurrentSettings->scrollback, -1, 1000000, 1, 100, 0);
 
     GtkWidget *scrollback_spin = gtk_spin_button_new(scrollback_adjustment, 1, 0);
+    gtk_widget_set_tooltip_text(scrollback_spin, "-1 keeps unlimited scrollback");
+    g_object_set_data(G_OBJECT(notebook), "scrollback", scrollback_spin);
     gtk_widget_set_size_request(scrollback_spin, 200, -1);
     gtk_grid_attach(GTK_GRID(display_grid), scrollback_spin, 1, 1, 1, 1);
 
@@ -667,12 +5643,16 @@ void DisplayTab(GtkNotebook *notebook) {
     gtk_grid_attach(GTK_GRID(display_grid), hide_scrollbar_title, 0, 3, 1, 1);
 
     GtkWidget *hide_scrollbar_check = gtk_check_button_new();
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(hide_scrollbar_check), CurrentSettings->hide_scrollbar);
+    g_object_set_data(G_OBJECT(notebook), "hide-scrollbar", hide_scrollbar_check);
     gtk_grid_attach(GTK_GRID(display_grid), hide_scrollbar_check, 1, 3, 1, 1);
 
     GtkWidget *hide_menu_bar_title = gtk_label_new("Hide Menu Bar:");
     gtk_grid_attach(GTK_GRID(display_grid), hide_menu_bar_title, 0, 4, 1, 1);
 
     GtkWidget *hide_menu_bar_check = gtk_check_button_new();
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(hide_menu_bar_check), CurrentSettings->hide_menu_bar);
+    g_object_set_data(G_OBJECT(notebook), "hide-menu-bar", hide_menu_bar_check);
     gtk_grid_attach(GTK_GRID(display_grid), hide_menu_bar_check, 1, 4, 1, 1);
 
     GtkWidget *hide_close_buttons_title = gtk_label_new("Hide Close Buttons:");
@@ -685,6 +5665,8 @@ void DisplayTab(GtkNotebook *notebook) {
     gtk_grid_attach(GTK_GRID(display_grid), hide_mouse_pointer_title, 0, 6, 1, 1);
 
     GtkWidget *hide_mouse_pointer_check = gtk_check_button_new();
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(hide_mouse_pointer_check), CurrentSettings->hide_mouse_pointer);
+    g_object_set_data(G_OBJECT(notebook), "hide-mouse-pointer", hide_mouse_pointer_check);
     gtk_grid_attach(GTK_GRID(display_grid), hide_mouse_pointer_check, 1, 6, 1, 1);
 
     gtk_widget_set_halign(tab_position_label, GTK_ALIGN_START);
@@ -707,22 +5689,94 @@ void AdvancedTab(GtkNotebook *notebook) {
 
     GtkWidget *select_word_label = gtk_label_new("Select-by-word characters:");
     GtkWidget *characters_entry = gtk_entry_new();
-    gtk_entry_set_text(GTK_ENTRY(characters_entry), "-A-Za-z0-9,./?%&#:_");
+    gtk_entry_set_text(GTK_ENTRY(characters_entry), CurrentSettings->word_chars);
+    g_object_set_data(G_OBJECT(notebook), "word-chars", characters_entry);
+
+    GtkWidget *pipe_command_label = gtk_label_new("Pipe scrollback to command:");
+    GtkWidget *pipe_command_entry = gtk_entry_new();
+    gtk_entry_set_text(GTK_ENTRY(pipe_command_entry), CurrentSettings->pipe_command);
+    gtk_widget_set_tooltip_text(pipe_command_entry, "Runs in a new tab with the scrollback on standard input");
+    g_object_set_data(G_OBJECT(notebook), "pipe-command", pipe_command_entry);
 
     GtkWidget *disable_menu_label = gtk_label_new("Disable menu shortcut key (F10 by default):");
     GtkWidget *disable_menu_checkbox = gtk_check_button_new();
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(disable_menu_checkbox), CurrentSettings->disable_menu_key);
+    g_object_set_data(G_OBJECT(notebook), "disable-menu-key", disable_menu_checkbox);
 
     GtkWidget *disable_alt_n_label = gtk_label_new("Disable using Alt-n for tabs and menu:");
     GtkWidget *disable_alt_n_checkbox = gtk_check_button_new();
 
     GtkWidget *disable_confirm_label = gtk_label_new("Disable confirmation before closing a window with multiple tabs:");
     GtkWidget *disable_confirm_checkbox = gtk_check_button_new();
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(disable_confirm_checkbox), CurrentSettings->disable_confirm);
+    g_object_set_data(G_OBJECT(notebook), "disable-confirm", disable_confirm_checkbox);
+
+    GtkWidget *silence_label = gtk_label_new("Alert on background tab silence after seconds (0 = off):");
+    GtkAdjustment *silence_adjustment = gtk_adjustment_new(CurrentSettings->silence_seconds, 0, 86400, 1, 10, 0);
+    GtkWidget *silence_spin = gtk_spin_button_new(silence_adjustment, 1, 0);
+    g_object_set_data(G_OBJECT(notebook), "silence-seconds", silence_spin);
+
+    GtkWidget *notify_tabs_label = gtk_label_new("Send a notification on background tab activity or silence:");
+    GtkWidget *notify_tabs_checkbox = gtk_check_button_new();
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(notify_tabs_checkbox), CurrentSettings->notify_tabs);
+    g_object_set_data(G_OBJECT(notebook), "notify-tabs", notify_tabs_checkbox);
+
+    GtkWidget *export_metrics_label = gtk_label_new("Export metrics to $XDG_RUNTIME_DIR/illumiterm:");
+    GtkWidget *export_metrics_checkbox = gtk_check_button_new();
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(export_metrics_checkbox), CurrentSettings->export_metrics);
+    g_object_set_data(G_OBJECT(notebook), "export-metrics", export_metrics_checkbox);
+
+    GtkWidget *archive_scrollback_label = gtk_label_new("Archive rows trimmed from scrollback to compressed files:");
+    GtkWidget *archive_scrollback_checkbox = gtk_check_button_new();
+    gtk_widget_set_tooltip_text(archive_scrollback_checkbox, "Only applies when the scrollback is limited");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(archive_scrollback_checkbox), CurrentSettings->archive_scrollback);
+    g_object_set_data(G_OBJECT(notebook), "archive-scrollback", archive_scrollback_checkbox);
+
+    GtkWidget *keep_archive_label = gtk_label_new("Keep scrollback archives in $XDG_CACHE_HOME/illumiterm after the tab closes:");
+    GtkWidget *keep_archive_checkbox = gtk_check_button_new();
+    gtk_widget_set_tooltip_text(keep_archive_checkbox, "Otherwise an archive is deleted when its tab closes");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(keep_archive_checkbox), CurrentSettings->keep_archive);
+    g_object_set_data(G_OBJECT(notebook), "keep-archive", keep_archive_checkbox);
+
+    GtkWidget *inline_images_label = gtk_label_new("Show inline SIXEL images:");
+    GtkWidget *inline_images_checkbox = gtk_check_button_new();
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(inline_images_checkbox), CurrentSettings->inline_images);
+    g_object_set_data(G_OBJECT(notebook), "inline-images", inline_images_checkbox);
+
+    GtkWidget *image_memory_label = gtk_label_new("Image memory limit across all tabs (MiB):");
+    GtkAdjustment *image_memory_adjustment = gtk_adjustment_new(CurrentSettings->image_memory, 1, 4096, 1, 16, 0);
+    GtkWidget *image_memory_spin = gtk_spin_button_new(image_memory_adjustment, 1, 0);
+    g_object_set_data(G_OBJECT(notebook), "image-memory", image_memory_spin);
+
+    GtkWidget *window_processes_label = gtk_label_new("Spread new windows across processes (1 = one process):");
+    GtkAdjustment *window_processes_adjustment = gtk_adjustment_new(CurrentSettings->window_processes, 1, WINDOW_PROCESSES_MAX, 1, 1, 0);
+    GtkWidget *window_processes_spin = gtk_spin_button_new(window_processes_adjustment, 1, 0);
+    gtk_widget_set_tooltip_text(window_processes_spin, "A terminal flooding output then only slows down the windows in its own process");
+    g_object_set_data(G_OBJECT(notebook), "window-processes", window_processes_spin);
+
+    GtkWidget *accessibility_label = gtk_label_new("Expose terminal text to assistive technologies (on restart):");
+    GtkWidget *accessibility_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(accessibility_combo), "When one is active");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(accessibility_combo), "Always");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(accessibility_combo), "Never");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(accessibility_combo), CurrentSettings->accessibility);
+    g_object_set_data(G_OBJECT(notebook), "accessibility", accessibility_combo);
 
     GtkWidget *widgets[] = {
         select_word_label, characters_entry,
+        pipe_command_label, pipe_command_entry,
         disable_menu_label, disable_menu_checkbox,
         disable_alt_n_label, disable_alt_n_checkbox,
-        disable_confirm_label, disable_confirm_checkbox
+        disable_confirm_label, disable_confirm_checkbox,
+        silence_label, silence_spin,
+        notify_tabs_label, notify_tabs_checkbox,
+        export_metrics_label, export_metrics_checkbox,
+        archive_scrollback_label, archive_scrollback_checkbox,
+        keep_archive_label, keep_archive_checkbox,
+        inline_images_label, inline_images_checkbox,
+        image_memory_label, image_memory_spin,
+        window_processes_label, window_processes_spin,
+        accessibility_label, accessibility_combo
     };
 
     for (int i = 0; i < G_N_ELEMENTS(widgets); i += 2) {
@@ -734,6 +5788,20 @@ void AdvancedTab(GtkNotebook *notebook) {
     gtk_notebook_append_page(notebook, advanced_grid, advanced_tab);
 }
 
+void CheckShortcuts(GtkEditable *editable, gpointer user_data) {
+    GtkWidget **entries = g_object_get_data(G_OBJECT(user_data), "shortcut-entries");
+    gchar *shortcuts[SHORTCUT_COUNT];
+    for (int i = 0; i < SHORTCUT_COUNT; i++) {
+        shortcuts[i] = (gchar *) gtk_entry_get_text(GTK_ENTRY(entries[i]));
+    }
+
+    GString *conflicts = g_string_new(NULL);
+    g_hash_table_unref(CompileKeybindings(shortcuts, conflicts));
+    g_strchomp(conflicts->str);
+    gtk_label_set_text(GTK_LABEL(g_object_get_data(G_OBJECT(user_data), "shortcut-conflicts")), conflicts->str);
+    g_string_free(conflicts, TRUE);
+}
+
 void ShortcutsTab(GtkNotebook *notebook) {
     GtkWidget *shortcuts_tab = gtk_label_new("Shortcuts");
 
@@ -743,81 +5811,102 @@ void ShortcutsTab(GtkNotebook *notebook) {
     gtk_container_set_border_width(GTK_CONTAINER(shortcuts_grid), 10);
     gtk_widget_set_halign(shortcuts_grid, GTK_ALIGN_END);
 
-    GtkWidget *labels[] = {
-        gtk_label_new("New Window:"),
-        gtk_label_new("New Tab:"),
-        gtk_label_new("Close Tab:"),
-        gtk_label_new("Close Window:"),
-        gtk_label_new("Copy:"),
-        gtk_label_new("Paste:"),
-        gtk_label_new("Zoom In:"),
-        gtk_label_new("Zoom Out:"),
-        gtk_label_new("Zoom Reset:"),
-        gtk_label_new("Name Tab:"),
-        gtk_label_new("Previous Tab:"),
-        gtk_label_new("Next Tab:"),
-        gtk_label_new("Move Tab Left:"),
-        gtk_label_new("Move Tab Right:"),
-        gtk_label_new("Move Window Left:"),
-        gtk_label_new("Move Window Right:"),
-        gtk_label_new("Enter Fullscreen:"),
-        gtk_label_new("Reset Window Position:"),      
-    };
-    
-    GtkWidget *shortcut_entries[] = {
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new(),
-        gtk_entry_new()
-    };
-
-    const char *default_shortcuts[] = {
-        "Shift+Ctrl+N",
-        "Shift+Ctrl+T",
-        "Shift+Ctrl+W",
-        "Shift+Ctrl+Q",
-        "Shift+Ctrl+C",
-        "Shift+Ctrl+V",
-        "Shift+Ctrl++",
-        "Shift+Ctrl+_",
-        "Shift+Ctrl+)",
-        "Shift+Ctrl+I",
-        "Shift+Ctrl+Left",
-        "Shift+Ctrl+Right",
-        "Shift+Ctrl+Page Up",
-        "Shift+Ctrl+Page Down",
-        "Super+Page Left",  
-        "Super+Page Right",  
-        "Super+Page Up",  
-        "Super+Page Down",  
+    GtkWidget **shortcut_entries = g_new(GtkWidget *, SHORTCUT_COUNT);
+    g_object_set_data_full(G_OBJECT(notebook), "shortcut-entries", shortcut_entries, g_free);
 
-    };
+    for (int i = 0; i < SHORTCUT_COUNT; ++i) {
+        gchar *text = g_strdup_printf("%s:", ShortcutLabels[i]);
+        GtkWidget *label = gtk_label_new(text);
+        g_free(text);
 
-    for (int i = 0; i < G_N_ELEMENTS(labels); ++i) {
-        gtk_entry_set_text(GTK_ENTRY(shortcut_entries[i]), default_shortcuts[i]);
+        shortcut_entries[i] = gtk_entry_new();
+        gtk_entry_set_text(GTK_ENTRY(shortcut_entries[i]), CurrentSettings->shortcuts[i]);
+        g_signal_connect(shortcut_entries[i], "changed", G_CALLBACK(CheckShortcuts), notebook);
 
-        gtk_grid_attach(GTK_GRID(shortcuts_grid), labels[i], 0, i, 1, 1);
+        gtk_grid_attach(GTK_GRID(shortcuts_grid), label, 0, i, 1, 1);
         gtk_grid_attach(GTK_GRID(shortcuts_grid), shortcut_entries[i], 1, i, 1, 1);
     }
+
+    GtkWidget *conflicts_label = gtk_label_new(NULL);
+    gtk_style_context_add_class(gtk_widget_get_style_context(conflicts_label), "marked");
+    g_object_set_data(G_OBJECT(notebook), "shortcut-conflicts", conflicts_label);
+    gtk_grid_attach(GTK_GRID(shortcuts_grid), conflicts_label, 0, SHORTCUT_COUNT, 2, 1);
+    CheckShortcuts(NULL, notebook);
+
     gtk_notebook_append_page(notebook, shortcuts_grid, shortcuts_tab);
 }
 
-void OkButton(void) {
-    g_print("OK button clicked!\n");
+gboolean GetToggle(GtkNotebook *notebook, const gchar *key) {
+    return gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(g_object_get_data(G_OBJECT(notebook), key)));
+}
+
+gint GetSpin(GtkNotebook *notebook, const gchar *key) {
+    return gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(g_object_get_data(G_OBJECT(notebook), key)));
+}
+
+void OkButton(GtkWidget *button, gpointer user_data) {
+    GtkNotebook *notebook = GTK_NOTEBOOK(user_data);
+    Settings *settings = CopySettings(CurrentSettings);
+
+    g_free(settings->font);
+    settings->font = g_strdup(gtk_button_get_label(GTK_BUTTON(g_object_get_data(G_OBJECT(notebook), "font"))));
+    gtk_color_chooser_get_rgba(GTK_COLOR_CHOOSER(g_object_get_data(G_OBJECT(notebook), "foreground")), &settings->foreground);
+    gtk_color_chooser_get_rgba(GTK_COLOR_CHOOSER(g_object_get_data(G_OBJECT(notebook), "background")), &settings->background);
+    const gchar *palette = gtk_combo_box_get_active_id(GTK_COMBO_BOX(g_object_get_data(G_OBJECT(notebook), "palette")));
+    if (palette != NULL) {
+        g_free(settings->palette);
+        settings->palette = g_strdup(palette);
+    }
+    if (FindPalette(settings->palette) == NULL) {
+        GtkWidget **buttons = g_object_get_data(G_OBJECT(notebook), "palette-buttons");
+        for (int i = 0; i < PALETTE_SIZE; i++) {
+            gtk_color_chooser_get_rgba(GTK_COLOR_CHOOSER(buttons[i]), &settings->custom_palette[i]);
+        }
+    }
+    settings->cursor_blink_time = GetSpin(notebook, "cursor-blink-time");
+    settings->cursor_blink_timeout = GetSpin(notebook, "cursor-blink-timeout");
+    settings->allow_bold = GetToggle(notebook, "allow-bold");
+    settings->bold_is_bright = GetToggle(notebook, "bold-is-bright");
+    settings->cursor_blink = GetToggle(notebook, "cursor-blink");
+    settings->cursor_shape = GetToggle(notebook, "underline-cursor") ? VTE_CURSOR_SHAPE_UNDERLINE : VTE_CURSOR_SHAPE_BLOCK;
+    settings->audible_bell = GetToggle(notebook, "audible-bell");
+
+    gint tab_position = gtk_combo_box_get_active(GTK_COMBO_BOX(g_object_get_data(G_OBJECT(notebook), "tab-position")));
+    settings->tab_position = TabPositions[CLAMP(tab_position, 0, (gint) G_N_ELEMENTS(TabPositions) - 1)];
+    settings->columns = GetSpin(notebook, "columns");
+    settings->rows = GetSpin(notebook, "rows");
+    settings->scrollback = GetSpin(notebook, "scrollback");
+    settings->hide_scrollbar = GetToggle(notebook, "hide-scrollbar");
+    settings->hide_menu_bar = GetToggle(notebook, "hide-menu-bar");
+    settings->hide_mouse_pointer = GetToggle(notebook, "hide-mouse-pointer");
+
+    g_free(settings->word_chars);
+    settings->word_chars = g_strdup(gtk_entry_get_text(GTK_ENTRY(g_object_get_data(G_OBJECT(notebook), "word-chars"))));
+    g_free(settings->pipe_command);
+    settings->pipe_command = g_strdup(gtk_entry_get_text(GTK_ENTRY(g_object_get_data(G_OBJECT(notebook), "pipe-command"))));
+    settings->disable_menu_key = GetToggle(notebook, "disable-menu-key");
+    settings->disable_confirm = GetToggle(notebook, "disable-confirm");
+    settings->silence_seconds = GetSpin(notebook, "silence-seconds");
+    settings->notify_tabs = GetToggle(notebook, "notify-tabs");
+    settings->export_metrics = GetToggle(notebook, "export-metrics");
+    settings->archive_scrollback = GetToggle(notebook, "archive-scrollback");
+    settings->keep_archive = GetToggle(notebook, "keep-archive");
+    settings->inline_images = GetToggle(notebook, "inline-images");
+    settings->image_memory = GetSpin(notebook, "image-memory");
+    settings->window_processes = GetSpin(notebook, "window-processes");
+    gint accessibility = gtk_combo_box_get_active(GTK_COMBO_BOX(g_object_get_data(G_OBJECT(notebook), "accessibility")));
+    settings->accessibility = CLAMP(accessibility, 0, (gint) G_N_ELEMENTS(AccessibilityNames) - 1);
+
+    GtkWidget **shortcut_entries = g_object_get_data(G_OBJECT(notebook), "shortcut-entries");
+    for (int i = 0; i < SHORTCUT_COUNT; i++) {
+        g_free(settings->shortcuts[i]);
+        settings->shortcuts[i] = g_strdup(gtk_entry_get_text(GTK_ENTRY(shortcut_entries[i])));
+    }
+    CompileSettingsKeybindings(settings);
+
+    SaveSettings(settings);
+    ReplaceSettings(settings);
+    gtk_widget_destroy(gtk_widget_get_toplevel(button));
 }
 
 void Preferences(GtkMenuItem *menu_item, gpointer user_data)
@@ -825,7 +5914,6 @@ void Preferences(GtkMenuItem *menu_item, gpointer user_data)
     GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
     gtk_window_set_title(GTK_WINDOW(window), "Preferences");
     gtk_window_set_default_size(GTK_WINDOW(window), 400, 300);
-    g_signal_connect(window, "destroy", G_CALLBACK(gtk_widget_destroyed), &window);
     gtk_window_set_icon_from_file(GTK_WINDOW(window), "/usr/share/icons/hicolor/48x48/apps/illumiterm.png", NULL);
     gtk_window_set_type_hint(GTK_WINDOW(window), GDK_WINDOW_TYPE_HINT_DIALOG);
 
@@ -858,7 +5946,8 @@ void Preferences(GtkMenuItem *menu_item, gpointer user_data)
     GtkWidget *ok_button = gtk_button_new_with_label("OK");
     gtk_container_add(GTK_CONTAINER(buttons_box), ok_button);
     gtk_container_add(GTK_CONTAINER(button_box), buttons_box);
-    g_signal_connect(ok_button, "clicked", G_CALLBACK(OkButton), NULL);
+    g_signal_connect(ok_button, "clicked", G_CALLBACK(OkButton), notebook);
+    g_object_set_data(G_OBJECT(window), "ok-button", ok_button);
 
     gtk_widget_show_all(window);
 }
@@ -891,9 +5980,7 @@ GtkWidget* EditMenuHelper(const gchar* iconPath, const gchar* label, const gchar
     return menuItem;
 }
 
-GtkWidget* EditMenu() {
-    GtkWidget *edit_menu = gtk_menu_new();
-
+GtkWidget* EditMenu(GtkWidget *edit_menu) {
     GtkWidget *copy_item = EditMenuHelper("/usr/share/icons/hicolor/24x24/apps/edit-copy.svg", "Copy", "Shift+Ctrl+C", G_CALLBACK(Copy));
     gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), copy_item);
 
@@ -906,6 +5993,30 @@ GtkWidget* EditMenu() {
     GtkWidget *clear_scrollback_item = EditMenuHelper("/usr/share/icons/hicolor/24x24/apps/edit-clear.svg", "Clear Scrollback", "", G_CALLBACK(ClearScrollback));
     gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), clear_scrollback_item);
 
+    GtkWidget *pipe_scrollback_item = EditMenuHelper("/usr/share/icons/hicolor/16x16/apps/preferences-system-search-symbolic.svg", "Pipe Scrollback to Command", "", G_CALLBACK(PipeScrollback));
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), pipe_scrollback_item);
+
+    GtkWidget *save_scrollback_item = EditMenuHelper("/usr/share/icons/hicolor/24x24/apps/document-save.svg", "Save Scrollback...", "", G_CALLBACK(SaveScrollback));
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), save_scrollback_item);
+
+    GtkWidget *export_archive_item = EditMenuHelper("/usr/share/icons/hicolor/24x24/apps/document-save.svg", "Export Scrollback Archive...", "", G_CALLBACK(ExportArchive));
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), export_archive_item);
+
+    separator = gtk_separator_menu_item_new();
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), separator);
+
+    GtkWidget *previous_prompt_item = EditMenuHelper("/usr/share/icons/hicolor/24x24/apps/go-up.svg", "Previous Prompt", "", G_CALLBACK(PreviousPrompt));
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), previous_prompt_item);
+
+    GtkWidget *next_prompt_item = EditMenuHelper("/usr/share/icons/hicolor/24x24/apps/go-down.svg", "Next Prompt", "", G_CALLBACK(NextPrompt));
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), next_prompt_item);
+
+    GtkWidget *copy_output_item = EditMenuHelper("/usr/share/icons/hicolor/24x24/apps/edit-copy.svg", "Copy Command Output", "", G_CALLBACK(CopyCommandOutput));
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), copy_output_item);
+
+    GtkWidget *command_history_item = EditMenuHelper("/usr/share/icons/hicolor/16x16/apps/preferences-system-search-symbolic.svg", "Command History", "", G_CALLBACK(CommandHistory));
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), command_history_item);
+
     separator = gtk_separator_menu_item_new();
     gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), separator);
 
@@ -921,6 +6032,24 @@ GtkWidget* EditMenu() {
     separator = gtk_separator_menu_item_new();
     gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), separator);
 
+    GtkWidget *light_dark_item = EditMenuHelper("/usr/share/icons/hicolor/16x16/apps/preferences-system-search-symbolic.svg", "Toggle Light/Dark", "", G_CALLBACK(ToggleLightDark));
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), light_dark_item);
+
+    separator = gtk_separator_menu_item_new();
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), separator);
+
+    GtkWidget *hud_item = EditMenuHelper("/usr/share/icons/hicolor/16x16/apps/preferences-system-search-symbolic.svg", "Performance HUD", "", G_CALLBACK(ToggleHud));
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), hud_item);
+
+    GtkWidget *trace_item = EditMenuHelper("/usr/share/icons/hicolor/16x16/apps/preferences-system-search-symbolic.svg", "Trace Input Latency", "", G_CALLBACK(ToggleLatencyTracing));
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), trace_item);
+
+    GtkWidget *export_item = EditMenuHelper("/usr/share/icons/hicolor/16x16/apps/preferences-system-search-symbolic.svg", "Export Latency Histogram", "", G_CALLBACK(ExportLatency));
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), export_item);
+
+    separator = gtk_separator_menu_item_new();
+    gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), separator);
+
     GtkWidget *preferences_item = EditMenuHelper("/usr/share/icons/hicolor/24x24/apps/configure.svg", "Preferences", "", G_CALLBACK(Preferences));
     gtk_menu_shell_append(GTK_MENU_SHELL(edit_menu), preferences_item);
 
@@ -957,9 +6086,7 @@ GtkWidget* TabsMenuHelper(const gchar *icon_path, const gchar *label_text, const
     return menu_item;
 }
 
-GtkWidget* TabsMenu() {
-    GtkWidget *tabs_menu = gtk_menu_new();
-
+GtkWidget* TabsMenu(GtkWidget *tabs_menu) {
     GtkWidget *separator = gtk_separator_menu_item_new();
     gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), separator);
 
@@ -984,6 +6111,50 @@ GtkWidget* TabsMenu() {
     GtkWidget *move_tab_right = TabsMenuHelper("/usr/share/icons/hicolor/24x24/apps/go-down.svg", "Move Tab Right", "Shift+Ctrl+Page Down", G_CALLBACK(MoveTabRight));
     gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), move_tab_right);
 
+    separator = gtk_separator_menu_item_new();
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), separator);
+
+    GtkWidget *split_horizontally = TabsMenuHelper("/usr/share/icons/hicolor/24x24/apps/view-split-top-bottom.svg", "Split Horizontally", "", G_CALLBACK(SplitHorizontally));
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), split_horizontally);
+
+    GtkWidget *split_vertically = TabsMenuHelper("/usr/share/icons/hicolor/24x24/apps/view-split-left-right.svg", "Split Vertically", "", G_CALLBACK(SplitVertically));
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), split_vertically);
+
+    GtkWidget *close_pane = TabsMenuHelper("/usr/share/icons/hicolor/24x24/apps/view-close.svg", "Close Pane", "", G_CALLBACK(ClosePane));
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), close_pane);
+
+    separator = gtk_separator_menu_item_new();
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), separator);
+
+    GtkWidget *broadcast_window = TabsMenuHelper("/usr/share/icons/hicolor/16x16/apps/preferences-system-search-symbolic.svg", "Broadcast to Window Tabs", "", G_CALLBACK(BroadcastToWindow));
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), broadcast_window);
+
+    GtkWidget *broadcast_all = TabsMenuHelper("/usr/share/icons/hicolor/16x16/apps/preferences-system-search-symbolic.svg", "Broadcast to All Tabs", "", G_CALLBACK(BroadcastToAll));
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), broadcast_all);
+
+    GtkWidget *broadcast_group = TabsMenuHelper("/usr/share/icons/hicolor/16x16/apps/preferences-system-search-symbolic.svg", "Broadcast to Group", "", G_CALLBACK(BroadcastToGroup));
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), broadcast_group);
+
+    GtkWidget *group_tab = TabsMenuHelper("/usr/share/icons/hicolor/16x16/apps/preferences-system-search-symbolic.svg", "Add/Remove Tab in Group", "", G_CALLBACK(ToggleBroadcastGroup));
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), group_tab);
+
+    separator = gtk_separator_menu_item_new();
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), separator);
+
+    GtkWidget *tab_overview = TabsMenuHelper("/usr/share/icons/hicolor/16x16/apps/preferences-system-search-symbolic.svg", "Tab Overview", "Shift+Ctrl+O", G_CALLBACK(TabOverview));
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), tab_overview);
+
+    GtkWidget *process_monitor = TabsMenuHelper("/usr/share/icons/hicolor/16x16/apps/preferences-system-search-symbolic.svg", "Process Monitor", "", G_CALLBACK(ProcessMonitor));
+    gtk_menu_shell_append(GTK_MENU_SHELL(tabs_menu), process_monitor);
+
+    if (ShardIndex > 0) {
+        GtkWidget* spread[] = {broadcast_all, tab_overview, process_monitor};
+        for (int i = 0; i < G_N_ELEMENTS(spread); i++) {
+            gtk_widget_set_sensitive(spread[i], FALSE);
+            gtk_widget_set_tooltip_text(spread[i], "Only covers the windows of one process while WindowProcesses is above 1");
+        }
+    }
+
     return tabs_menu;
 }
 
@@ -1015,25 +6186,87 @@ GtkWidget* PositionMenuHelper(const gchar *icon_path, const gchar *label_text, c
     return menu_item;
 }
 
+GtkWidget* GetActiveWindow(void) {
+    TerminalState* state = GetActiveTerminalState();
+    return state != NULL ? state->window : NULL;
+}
+
+gboolean GetWorkarea(GtkWidget* window, GdkRectangle* workarea) {
+    GdkWindow* gdk_window = gtk_widget_get_window(window);
+    if (gdk_window == NULL) {
+        return FALSE;
+    }
+    GdkMonitor* monitor = gdk_display_get_monitor_at_window(gdk_window_get_display(gdk_window), gdk_window);
+    gdk_monitor_get_workarea(monitor, workarea);
+    return TRUE;
+}
+
+void PlaceWindow(GtkWidget* window, gint x, gint y, gint width, gint height) {
+    gtk_window_unfullscreen(GTK_WINDOW(window));
+    gtk_window_unmaximize(GTK_WINDOW(window));
+    gtk_window_move(GTK_WINDOW(window), x, y);
+    gtk_window_resize(GTK_WINDOW(window), width, height);
+}
+
 void MoveWindowLeft(void) {
-    g_print("MoveWindowLeft\n");
+    GtkWidget* window = GetActiveWindow();
+    GdkRectangle workarea;
+    if (window != NULL && GetWorkarea(window, &workarea)) {
+        PlaceWindow(window, workarea.x, workarea.y, workarea.width / 2, workarea.height);
+    }
 }
 
 void MoveWindowRight(void) {
-    g_print("MoveWindowRight\n");
+    GtkWidget* window = GetActiveWindow();
+    GdkRectangle workarea;
+    if (window != NULL && GetWorkarea(window, &workarea)) {
+        PlaceWindow(window, workarea.x + workarea.width / 2, workarea.y, workarea.width - workarea.width / 2, workarea.height);
+    }
 }
 
 void EnterFullscreen(void) {
-    g_print("EnterFullscreen\n");
+    GtkWidget* window = GetActiveWindow();
+    if (window == NULL || gtk_widget_get_window(window) == NULL) {
+        return;
+    }
+    if (gdk_window_get_state(gtk_widget_get_window(window)) & GDK_WINDOW_STATE_FULLSCREEN) {
+        gtk_window_unfullscreen(GTK_WINDOW(window));
+    } else {
+        gtk_window_fullscreen(GTK_WINDOW(window));
+    }
 }
 
 void ResetWindowPosition(void) {
-    g_print("ResetWindowPosition\n");
+    GtkWidget* window = GetActiveWindow();
+    GdkRectangle workarea;
+    if (window != NULL && GetWorkarea(window, &workarea)) {
+        gint width = MIN(640, workarea.width);
+        gint height = MIN(460, workarea.height);
+        PlaceWindow(window, workarea.x + (workarea.width - width) / 2, workarea.y + (workarea.height - height) / 2, width, height);
+    }
 }
 
-GtkWidget* PositionMenu() {
-    GtkWidget *position_menu = gtk_menu_new();
+void (*ShortcutActions[SHORTCUT_COUNT])(void) = {
+    NewWindow, NewTab, CloseTab, CloseWindow, Copy, Paste, ZoomIn, ZoomOut, ZoomReset,
+    NameTab, PreviousTab, NextTab, MoveTabLeft, MoveTabRight,
+    MoveWindowLeft, MoveWindowRight, EnterFullscreen, ResetWindowPosition, TabOverview
+};
+
+gboolean KeyPressed(GtkWidget* window, GdkEventKey* event, gpointer data) {
+    GdkModifierType modifiers = event->state & (GDK_SHIFT_MASK | GDK_CONTROL_MASK | GDK_MOD1_MASK);
+    if (event->state & (GDK_SUPER_MASK | GDK_MOD4_MASK)) {
+        modifiers |= GDK_SUPER_MASK;
+    }
+    guint64 key = ShortcutKey(event->keyval, modifiers);
+    gint action = GPOINTER_TO_INT(g_hash_table_lookup(CurrentSettings->keybindings, &key));
+    if (action == 0) {
+        return FALSE;
+    }
+    ShortcutActions[action - 1]();
+    return TRUE;
+}
 
+GtkWidget* PositionMenu(GtkWidget *position_menu) {
     GtkWidget *move_window_left = PositionMenuHelper("/usr/share/icons/hicolor/24x24/apps/go-previous.svg", "Move Window Left", "Super+Left", G_CALLBACK(MoveWindowLeft));
     gtk_menu_shell_append(GTK_MENU_SHELL(position_menu), move_window_left);
 
@@ -1054,9 +6287,7 @@ GtkWidget* PositionMenu() {
 
 void AboutWindow(GtkWindow* parent) {
     GtkAboutDialog* about_dialog = GTK_ABOUT_DIALOG(gtk_about_dialog_new());
-    GdkPixbuf* icon = gdk_pixbuf_new_from_file("/usr/share/icons/hicolor/48x48/apps/illumiterm.png", NULL);
-    gtk_window_set_icon(GTK_WINDOW(about_dialog), icon);
-    g_object_unref(icon);
+    gtk_window_set_icon_from_file(GTK_WINDOW(about_dialog), "/usr/share/icons/hicolor/48x48/apps/illumiterm.png", NULL);
 
     gtk_window_set_position(GTK_WINDOW(about_dialog), GTK_WIN_POS_NONE);
     gtk_widget_show_all(GTK_WIDGET(about_dialog));
@@ -1078,8 +6309,10 @@ void AboutWindow(GtkWindow* parent) {
                                                "Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.");
 
     GdkPixbuf* logo_pixbuf = gdk_pixbuf_new_from_file("/usr/share/icons/hicolor/96x96/apps/about.png", NULL);
-    gtk_about_dialog_set_logo(about_dialog, logo_pixbuf);
-    g_object_unref(logo_pixbuf);
+    if (logo_pixbuf != NULL) {
+        gtk_about_dialog_set_logo(about_dialog, logo_pixbuf);
+        g_object_unref(logo_pixbuf);
+    }
     
     const gchar* authors[] = {"Elijah Gordon", "<a href=\"mailto:braindisassemblue@gmail.com\">braindisassemblue@gmail.com</a>", NULL};
 
@@ -1115,8 +6348,7 @@ GtkWidget* AboutMenu() {
     return about_menu_item;
 }
 
-GtkWidget* HelpMenu() {
-    GtkWidget* help_menu = gtk_menu_new();
+GtkWidget* HelpMenu(GtkWidget* help_menu) {
     GtkWidget* about_menu_item = AboutMenu();
 
     gtk_menu_shell_append(GTK_MENU_SHELL(help_menu), about_menu_item);
@@ -1125,36 +6357,36 @@ GtkWidget* HelpMenu() {
 }
 
 void SearchIcon(void) {
-    g_print("SearchIcon\n");
+    SearchScrollback();
+}
+
+void BuildLazyMenu(GtkWidget* menu, gpointer data) {
+    GtkWidget* (*build)(GtkWidget*) = g_object_get_data(G_OBJECT(menu), "build");
+    if (build == NULL) {
+        return;
+    }
+    g_object_set_data(G_OBJECT(menu), "build", NULL);
+    build(menu);
+    gtk_container_foreach(GTK_CONTAINER(menu), (GtkCallback) gtk_widget_show_all, NULL);
+}
+
+GtkWidget* LazyMenuItem(const gchar* label, GtkWidget* (*build)(GtkWidget*)) {
+    GtkWidget* menu_item = gtk_menu_item_new_with_label(label);
+    GtkWidget* menu = gtk_menu_new();
+    g_object_set_data(G_OBJECT(menu), "build", build);
+    g_signal_connect(menu, "show", G_CALLBACK(BuildLazyMenu), NULL);
+    gtk_menu_item_set_submenu(GTK_MENU_ITEM(menu_item), menu);
+    return menu_item;
 }
 
 GtkWidget* CreateMenu() {
     GtkWidget *menu_bar = gtk_menu_bar_new();
 
-    GtkWidget *file_menu_item = gtk_menu_item_new_with_label("File");
-    GtkWidget *file_menu = FileMenu();
-    gtk_menu_item_set_submenu(GTK_MENU_ITEM(file_menu_item), file_menu);
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu_bar), file_menu_item);
-
-    GtkWidget *edit_menu_item = gtk_menu_item_new_with_label("Edit");
-    GtkWidget *edit_menu = EditMenu();
-    gtk_menu_item_set_submenu(GTK_MENU_ITEM(edit_menu_item), edit_menu);
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu_bar), edit_menu_item);
-
-    GtkWidget *tabs_menu_item = gtk_menu_item_new_with_label("Tabs");
-    GtkWidget *tabs_menu = TabsMenu();
-    gtk_menu_item_set_submenu(GTK_MENU_ITEM(tabs_menu_item), tabs_menu);
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu_bar), tabs_menu_item);
-
-    GtkWidget *position_menu_item = gtk_menu_item_new_with_label("Position");
-    GtkWidget *position_menu = PositionMenu();
-    gtk_menu_item_set_submenu(GTK_MENU_ITEM(position_menu_item), position_menu);
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu_bar), position_menu_item);
-
-    GtkWidget *help_menu_item = gtk_menu_item_new_with_label("Help");
-    GtkWidget *help_menu = HelpMenu();
-    gtk_menu_item_set_submenu(GTK_MENU_ITEM(help_menu_item), help_menu);
-    gtk_menu_shell_append(GTK_MENU_SHELL(menu_bar), help_menu_item);
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu_bar), LazyMenuItem("File", FileMenu));
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu_bar), LazyMenuItem("Edit", EditMenu));
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu_bar), LazyMenuItem("Tabs", TabsMenu));
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu_bar), LazyMenuItem("Position", PositionMenu));
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu_bar), LazyMenuItem("Help", HelpMenu));
     
 	GtkWidget *search_icon_item = gtk_menu_item_new();
 	GtkWidget *search_icon_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
@@ -1183,27 +6415,49 @@ GtkWidget* CreateMenu() {
 	return main_box;
 }   
 
-void SetNotebookShowTabs(GtkWidget* notebook) {
-    gtk_notebook_set_show_tabs(GTK_NOTEBOOK(notebook), FALSE);
-}
-
 GtkWidget* CreateNotebook(GtkWidget* widget) {
     GtkWidget* notebook = gtk_notebook_new();
-    SetNotebookShowTabs(notebook);
-
-    GtkWidget* scrolled_window = gtk_scrolled_window_new(NULL, NULL);
-    gtk_container_add(GTK_CONTAINER(scrolled_window), widget);
-    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_ALWAYS);
-    gtk_scrolled_window_set_min_content_height(GTK_SCROLLED_WINDOW(scrolled_window), 200);
+    gtk_notebook_set_scrollable(GTK_NOTEBOOK(notebook), TRUE);
+    g_signal_connect(notebook, "page-added", G_CALLBACK(SetNotebookShowTabs), NULL);
+    g_signal_connect(notebook, "page-removed", G_CALLBACK(SetNotebookShowTabs), NULL);
+    g_signal_connect_after(notebook, "switch-page", G_CALLBACK(TabSwitched), NULL);
 
-    GtkWidget* tab_label = gtk_label_new("Tab");
-    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), scrolled_window, tab_label);
+    AddTerminalPage(notebook, widget);
     gtk_widget_show_all(notebook);
 
     return notebook;
 }
 
-GtkWidget* CreateWindow(GtkWidget* menu_bar, GtkWidget* notebook) {
+void UpdateMenuBar(GtkWidget* window) {
+    GtkWidget* menu_bar = g_object_get_data(G_OBJECT(window), "menu-bar");
+    GtkWidget* vbox = gtk_bin_get_child(GTK_BIN(window));
+
+    if (CurrentSettings->hide_menu_bar && menu_bar != NULL) {
+        gtk_widget_destroy(menu_bar);
+        g_object_set_data(G_OBJECT(window), "menu-bar", NULL);
+    } else if (!CurrentSettings->hide_menu_bar && menu_bar == NULL) {
+        gint64 started = g_get_monotonic_time();
+        menu_bar = CreateMenu();
+        gtk_box_pack_start(GTK_BOX(vbox), menu_bar, FALSE, FALSE, 0);
+        gtk_box_reorder_child(GTK_BOX(vbox), menu_bar, 0);
+        gtk_widget_show_all(menu_bar);
+        g_object_set_data(G_OBJECT(window), "menu-bar", menu_bar);
+        MenuBuildTime = g_get_monotonic_time() - started;
+    }
+}
+
+gboolean FirstFrameDrawn(GtkWidget* window, cairo_t* cr, gpointer data) {
+    gint64 started = *(gint64*) g_object_get_data(G_OBJECT(window), "started");
+    g_signal_handlers_disconnect_by_func(window, FirstFrameDrawn, data);
+    g_print("First frame after %.2f ms (menu bar %s, built in %.2f ms; accessibility bridge %s, queried in %.2f ms)\n",
+            (g_get_monotonic_time() - started) / 1000.0,
+            CurrentSettings->hide_menu_bar ? "hidden" : "shown",
+            CurrentSettings->hide_menu_bar ? 0.0 : MenuBuildTime / 1000.0,
+            AccessibilityDecision, AccessibilityQueryTime / 1000.0);
+    return FALSE;
+}
+
+GtkWidget* CreateWindow(GtkWidget* notebook) {
     GtkWidget* window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
     GtkWidget* vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
     GtkWidget* scrolled_window = gtk_scrolled_window_new(NULL, NULL);
@@ -1211,41 +6465,558 @@ GtkWidget* CreateWindow(GtkWidget* menu_bar, GtkWidget* notebook) {
     gtk_container_add(GTK_CONTAINER(scrolled_window), notebook);
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
     gtk_window_set_icon_from_file(GTK_WINDOW(window), "/usr/share/icons/hicolor/48x48/apps/illumiterm.png", NULL);
-    gtk_box_pack_start(GTK_BOX(vbox), menu_bar, FALSE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(vbox), scrolled_window, TRUE, TRUE, 0);
     gtk_container_add(GTK_CONTAINER(window), vbox);
+    UpdateMenuBar(window);
     gtk_window_set_title(GTK_WINDOW(window), NULL);
     gtk_window_set_default_size(GTK_WINDOW(window), 640, 460);
     gtk_window_set_icon_name(GTK_WINDOW(window), NULL);
+    g_signal_connect(window, "configure-event", G_CALLBACK(WindowConfigured), NULL);
+    g_signal_connect(window, "check-resize", G_CALLBACK(AllocationStarted), NULL);
+    g_signal_connect_after(window, "check-resize", G_CALLBACK(AllocationFinished), NULL);
+    g_signal_connect(window, "delete-event", G_CALLBACK(ConfirmExit), NULL);
+    g_signal_connect(window, "key-press-event", G_CALLBACK(KeyPressed), NULL);
+    g_signal_connect(window, "notify::is-active", G_CALLBACK(UpdateWindowCursorBlink), NULL);
+    g_signal_connect(window, "window-state-event", G_CALLBACK(WindowStateChanged), NULL);
+    g_object_set_data(G_OBJECT(window), "notebook", notebook);
     gtk_widget_show_all(window);
 
     return window;
 }
 
-void CommandLine(GApplication *application, GApplicationCommandLine *cli, gpointer data) {
+GtkWidget* OpenWindow(GApplicationCommandLine *cli) {
     GtkWidget *widget = vte_terminal_new();
-    GtkWidget *menu_bar = CreateMenu();
-    GtkWidget *notebook = CreateNotebook(widget);
-    GtkWidget *window = CreateWindow(menu_bar, notebook);
+    GtkWidget *window = CreateWindow(CreateNotebook(widget));
+    g_object_set_data_full(G_OBJECT(window), "cli", g_object_ref(cli), g_object_unref);
+    return widget;
+}
+
+void MarkBenchmarkTerminal(GtkWidget *widget) {
+    g_object_set_data(G_OBJECT(widget), "benchmark", GINT_TO_POINTER(TRUE));
+    g_signal_connect(widget, "draw", G_CALLBACK(BenchmarkFrame), NULL);
+}
+
+void StartBenchmark(GApplicationCommandLine *cli, GtkWidget *widget, gint mib, gint panes, gint windows) {
+    gchar *command = g_strdup_printf("yes 'IllumiTerm throughput benchmark 0123456789 abcdefghijklmnopqrstuvwxyz' | head -c %" G_GINT64_FORMAT,
+                                     (gint64) mib * 1024 * 1024);
+    BenchmarkPending = BenchmarkPanes = panes * windows;
+    BenchmarkWindows = windows;
+    BenchmarkFrames = 0;
+    FeedBatches = 0;
+    BenchmarkStarted = g_get_monotonic_time();
+
+    for (gint w = 0; w < windows; w++) {
+        GtkWidget *first = w == 0 ? widget : OpenWindow(cli);
+        MarkBenchmarkTerminal(first);
+        SpawnVteTerminal(cli, gtk_widget_get_toplevel(first), first, command, NULL, NULL);
+
+        GQueue queue = G_QUEUE_INIT;
+        g_queue_push_tail(&queue, first);
+        for (gint i = 1; i < panes; i++) {
+            GtkWidget *terminal = g_queue_pop_head(&queue);
+            GtkOrientation orientation = g_bit_storage(i) % 2 == 1 ? GTK_ORIENTATION_HORIZONTAL : GTK_ORIENTATION_VERTICAL;
+            GtkWidget *split = SplitTerminal(GetTerminalState(terminal), orientation, command);
+            MarkBenchmarkTerminal(split);
+            g_queue_push_tail(&queue, terminal);
+            g_queue_push_tail(&queue, split);
+        }
+        g_queue_clear(&queue);
+    }
+    for (GList* l = Terminals; l != NULL && BenchmarkArchive; l = l->next) {
+        TerminalState* state = l->data;
+        if (g_object_get_data(G_OBJECT(state->terminal), "benchmark") != NULL) {
+            UpdateArchive(state, ARCHIVE_BENCHMARK_SCROLLBACK);
+            vte_terminal_set_scrollback_lines(VTE_TERMINAL(state->terminal), ARCHIVE_BENCHMARK_SCROLLBACK + ARCHIVE_MARGIN_ROWS);
+        }
+    }
+    g_free(command);
+}
+
+guint CountInstances(GType type) {
+    guint count = g_type_get_instance_count(type);
+    guint n_children = 0;
+    GType* children = g_type_children(type, &n_children);
+    for (guint i = 0; i < n_children; i++) {
+        count += CountInstances(children[i]);
+    }
+    g_free(children);
+    return count;
+}
+
+SoakSample SampleSoak(void) {
+    SoakSample sample = {0};
+    gchar* statm = NULL;
+    if (g_file_get_contents("/proc/self/statm", &statm, NULL, NULL)) {
+        guint64 pages = 0;
+        sscanf(statm, "%*u %" G_GUINT64_FORMAT, &pages);
+        sample.rss = pages * sysconf(_SC_PAGESIZE);
+        g_free(statm);
+    }
+    GDir* fds = g_dir_open("/proc/self/fd", 0, NULL);
+    if (fds != NULL) {
+        while (g_dir_read_name(fds) != NULL) {
+            sample.fds++;
+        }
+        g_dir_close(fds);
+    }
+    sample.objects = CountInstances(G_TYPE_OBJECT);
+    return sample;
+}
+
+gboolean CloseSoakDialogs(gpointer data) {
+    GList* windows = gtk_window_list_toplevels();
+    for (GList* l = windows; l != NULL; l = l->next) {
+        if (GTK_IS_ABOUT_DIALOG(l->data)) {
+            gtk_dialog_response(GTK_DIALOG(l->data), GTK_RESPONSE_CLOSE);
+        } else if (g_strcmp0(gtk_window_get_title(GTK_WINDOW(l->data)), "Preferences") == 0) {
+            gtk_button_clicked(GTK_BUTTON(g_object_get_data(G_OBJECT(l->data), "ok-button")));
+        }
+    }
+    g_list_free(windows);
+    return G_SOURCE_REMOVE;
+}
+
+void FinishSoak(void) {
+    if (!SoakBaselined) {
+        g_print("Soak: %u steps, no sample was taken after warm-up: inconclusive\n", SoakSteps);
+        DestroyAndQuit(gtk_widget_get_toplevel(SoakTerminal), 1);
+        return;
+    }
+    SoakSample sample = SampleSoak();
+    gboolean failed = sample.rss > SoakBaseline.rss + SOAK_RSS_GROWTH ||
+                      sample.fds > SoakBaseline.fds + SOAK_FD_GROWTH ||
+                      sample.objects > SoakBaseline.objects + SOAK_OBJECT_GROWTH;
+    gchar* baseline = g_format_size(SoakBaseline.rss);
+    gchar* rss = g_format_size(sample.rss);
+    gchar* peak = g_format_size(SoakPeak.rss);
+    g_print("Soak: %u steps, RSS %s -> %s (peak %s), %u -> %u fds, %u -> %u objects after warm-up: %s\n",
+            SoakSteps, baseline, rss, peak, SoakBaseline.fds, sample.fds, SoakBaseline.objects, sample.objects,
+            failed ? "FAILED" : "passed");
+    g_free(baseline);
+    g_free(rss);
+    g_free(peak);
+    DestroyAndQuit(gtk_widget_get_toplevel(SoakTerminal), failed ? 1 : 0);
+}
+
+gboolean SoakStep(gpointer data) {
+    TerminalState* state = GetTerminalState(SoakTerminal);
+    gint64 now = g_get_monotonic_time();
+    if (state == NULL) {
+        return G_SOURCE_REMOVE;
+    }
+
+    if (now - SoakSampled >= SOAK_SAMPLE_INTERVAL * G_USEC_PER_SEC) {
+        SoakSample sample = SampleSoak();
+        gchar* rss = g_format_size(sample.rss);
+        g_print("Soak: %3" G_GINT64_FORMAT " s, RSS %s, %u fds, %u objects, %u terminals\n",
+                (now - SoakStarted) / G_USEC_PER_SEC, rss, sample.fds, sample.objects, g_list_length(Terminals));
+        g_free(rss);
+        SoakSampled = now;
+        if (!SoakBaselined && now >= SoakWarmup) {
+            SoakBaseline = SoakPeak = sample;
+            SoakBaselined = TRUE;
+        }
+        SoakPeak.rss = MAX(SoakPeak.rss, sample.rss);
+    }
+    if (now >= SoakUntil) {
+        if (g_list_length(Terminals) == 1 || now >= SoakUntil + SOAK_SETTLE * G_USEC_PER_SEC) {
+            FinishSoak();
+            return G_SOURCE_REMOVE;
+        }
+        return G_SOURCE_CONTINUE;
+    }
+
+    GtkWidget* menu;
+    switch (SoakSteps++ % 7) {
+    case 0:
+        OpenTab(state, SOAK_CHILD, NULL);
+        gtk_notebook_set_current_page(GTK_NOTEBOOK(GetWindowNotebook(state->window)), 0);
+        break;
+    case 1:
+        SplitTerminal(state, SoakSteps % 2 ? GTK_ORIENTATION_HORIZONTAL : GTK_ORIENTATION_VERTICAL, SOAK_CHILD);
+        break;
+    case 2:
+        menu = ContextMenu();
+        gtk_menu_popup_at_widget(GTK_MENU(menu), SoakTerminal, GDK_GRAVITY_CENTER, GDK_GRAVITY_NORTH_WEST, NULL);
+        gtk_menu_shell_deactivate(GTK_MENU_SHELL(menu));
+        break;
+    case 3:
+        Preferences(NULL, NULL);
+        g_timeout_add(SOAK_INTERVAL, CloseSoakDialogs, NULL);
+        break;
+    case 4:
+        g_timeout_add(SOAK_INTERVAL, CloseSoakDialogs, NULL);
+        AboutWindow(GTK_WINDOW(state->window));
+        break;
+    case 5:
+        gtk_clipboard_set_text(gtk_clipboard_get(GDK_SELECTION_CLIPBOARD), "IllumiTerm soak paste\n", -1);
+        vte_terminal_paste_clipboard(VTE_TERMINAL(SoakTerminal));
+        break;
+    case 6: {
+        GApplicationCommandLine* cli = g_object_get_data(G_OBJECT(state->window), "cli");
+        GtkWidget* widget = OpenWindow(cli);
+        SpawnVteTerminal(cli, gtk_widget_get_toplevel(widget), widget, SOAK_CHILD, NULL, NULL);
+        break;
+    }
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void StartSoak(GApplicationCommandLine* cli, GtkWidget* widget, gint seconds) {
+    if (g_type_get_instance_count(GTK_TYPE_WINDOW) == 0) {
+        g_printerr("Soak: GObject instances are not counted, run with GOBJECT_DEBUG=instance-count\n");
+        DestroyAndQuit(gtk_widget_get_toplevel(widget), 1);
+        return;
+    }
+    if (seconds < SOAK_MINIMUM) {
+        g_printerr("Soak: needs at least %d seconds to sample after the %d second warm-up\n", SOAK_MINIMUM, SOAK_WARMUP);
+        DestroyAndQuit(gtk_widget_get_toplevel(widget), 1);
+        return;
+    }
+    SoakTerminal = widget;
+    SoakStarted = SoakSampled = g_get_monotonic_time();
+    SoakWarmup = SoakStarted + SOAK_WARMUP * G_USEC_PER_SEC;
+    SoakUntil = SoakStarted + (gint64) seconds * G_USEC_PER_SEC;
+    SpawnVteTerminal(cli, gtk_widget_get_toplevel(widget), widget, "cat > /dev/null", NULL, NULL);
+    g_timeout_add(SOAK_INTERVAL, SoakStep, NULL);
+}
+
+gint GetWindowProcesses(GVariantDict* options) {
+    gint processes = CurrentSettings->window_processes;
+    g_variant_dict_lookup(options, "window-processes", "i", &processes);
+    return CLAMP(processes, 1, WINDOW_PROCESSES_MAX);
+}
+
+void RoutedChildExited(GPid pid, gint status, gpointer data) {
+    GApplicationCommandLine* cli = data;
+    g_application_command_line_set_exit_status(cli, WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+    g_object_unref(cli);
+    g_spawn_close_pid(pid);
+}
+
+void RouteCommandLine(GApplicationCommandLine* cli, gint processes) {
+    gint argc = 0;
+    gchar** arguments = g_application_command_line_get_arguments(cli, &argc);
+    gchar** argv = g_new0(gchar*, argc + 2);
+    argv[0] = g_file_read_link("/proc/self/exe", NULL);
+    argv[1] = g_strdup_printf("--shard=%u", ShardNext++ % processes + 1);
+    for (gint i = 1; i < argc; i++) {
+        argv[i + 1] = g_strdup(arguments[i]);
+    }
+
+    GError* error = NULL;
+    GPid pid = 0;
+    if (argv[0] != NULL && g_spawn_async(g_application_command_line_get_cwd(cli), argv, (gchar**) g_application_command_line_get_environ(cli),
+                                         G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, &error)) {
+        g_child_watch_add(pid, RoutedChildExited, g_object_ref(cli));
+    } else {
+        g_printerr("Could not start a window process: %s\n", error != NULL ? error->message : g_strerror(errno));
+        g_application_command_line_set_exit_status(cli, 1);
+        g_clear_error(&error);
+    }
+    g_strfreev(arguments);
+    g_strfreev(argv);
+}
+
+gpointer ProbeInput(gpointer data) {
+    while (g_atomic_int_get(&ProbeRunning)) {
+        int_fast64_t expected = 0;
+        if (atomic_compare_exchange_strong(&ProbeSent, &expected, g_get_monotonic_time()) && write(ProbeFd, "x", 1) != 1) {
+            atomic_store(&ProbeSent, 0);
+        }
+        g_usleep(PROBE_INTERVAL * 1000);
+    }
+    return NULL;
+}
+
+void ProbeContentsChanged(VteTerminal* terminal, gpointer data) {
+    ProbeEchoed = atomic_load(&ProbeSent) != 0;
+}
+
+gboolean ProbeDrawn(GtkWidget* widget, cairo_t* cr, gpointer data) {
+    if (ProbeEchoed) {
+        gint64 latency = g_get_monotonic_time() - atomic_load(&ProbeSent);
+        g_array_append_val(ProbeSamples, latency);
+        ProbeEchoed = FALSE;
+        atomic_store(&ProbeSent, 0);
+    }
+    return FALSE;
+}
+
+gboolean StartProbe(gpointer data) {
+    TerminalState* state = GetTerminalState(ProbeTerminal);
+    if (state == NULL || state->pty == NULL) {
+        return G_SOURCE_REMOVE;
+    }
+    ProbeFd = vte_pty_get_fd(state->pty);
+    g_atomic_int_set(&ProbeRunning, 1);
+    ProbeThread = g_thread_new("latency-probe", ProbeInput, NULL);
+    return G_SOURCE_REMOVE;
+}
+
+gboolean FinishProbe(gpointer data) {
+    g_atomic_int_set(&ProbeRunning, 0);
+    if (ProbeThread != NULL) {
+        g_thread_join(ProbeThread);
+        ProbeThread = NULL;
+    }
+    g_array_sort(ProbeSamples, CompareTimes);
+
+    guint count = ProbeSamples->len;
+    gchar* mode = ProbeProcesses > 1 ? g_strdup_printf("%d window processes", ProbeProcesses) : g_strdup("single process");
+    if (count > 0) {
+        g_print("Latency: quiet window key-to-draw median %.2f ms, p99 %.2f ms, max %.2f ms over %u probes while another window floods (%s)\n",
+                g_array_index(ProbeSamples, gint64, count / 2) / 1000.0,
+                g_array_index(ProbeSamples, gint64, (count * 99 + 99) / 100 - 1) / 1000.0,
+                g_array_index(ProbeSamples, gint64, count - 1) / 1000.0, count, mode);
+    } else {
+        g_print("Latency: no probe echo was drawn (%s)\n", mode);
+    }
+    g_free(mode);
+    g_array_unref(ProbeSamples);
+    ProbeSamples = NULL;
+
+    if (GetTerminalState(ProbeTerminal) != NULL) {
+        DestroyAndQuit(gtk_widget_get_toplevel(ProbeTerminal), 0);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void StartLatencyBenchmark(GApplicationCommandLine* cli, GtkWidget* widget, gint seconds, gint processes) {
+    gchar* flood = g_strdup_printf(PROBE_FLOOD, seconds + 1);
+    gchar* option = g_strdup_printf("--window-processes=%d", processes);
+    gchar* argv[] = {g_file_read_link("/proc/self/exe", NULL), option, "--cmd", flood, NULL};
+    GError* error = NULL;
+
+    ProbeTerminal = widget;
+    ProbeProcesses = processes;
+    ProbeSamples = g_array_new(FALSE, FALSE, sizeof(gint64));
+    atomic_store(&ProbeSent, 0);
+    SpawnVteTerminal(cli, gtk_widget_get_toplevel(widget), widget, PROBE_QUIET, NULL, NULL);
+    g_signal_connect(widget, "contents-changed", G_CALLBACK(ProbeContentsChanged), NULL);
+    g_signal_connect_after(widget, "draw", G_CALLBACK(ProbeDrawn), NULL);
+
+    if (argv[0] == NULL || !g_spawn_async(NULL, argv, NULL, G_SPAWN_DEFAULT, NULL, NULL, NULL, &error)) {
+        g_printerr("Could not open the flooding window: %s\n", error != NULL ? error->message : g_strerror(errno));
+        g_clear_error(&error);
+    }
+    g_timeout_add(PROBE_DELAY, StartProbe, NULL);
+    g_timeout_add_seconds(seconds, FinishProbe, NULL);
+    g_free(argv[0]);
+    g_free(option);
+    g_free(flood);
+}
+
+void CommandLine(GApplication *application, GApplicationCommandLine *cli, gpointer data) {
+    GVariantDict *options = g_application_command_line_get_options_dict(cli);
+    if (g_variant_dict_contains(options, "trace-latency") && !LatencyTracing) {
+        SetLatencyTracing(TRUE);
+    }
+
+    gint64 started = ProcessStarted != 0 ? ProcessStarted : g_get_monotonic_time();
+    ProcessStarted = 0;
+
+    gint sampled = 0;
+    if (g_variant_dict_lookup(options, "process-benchmark", "i", &sampled) && sampled > 0) {
+        BenchmarkProcessSampler(CLAMP(sampled, 1, 10000));
+        return;
+    }
 
     g_application_hold(application);
     g_object_set_data_full(G_OBJECT(cli), "application", application, (GDestroyNotify) g_application_release);
-    g_object_set_data_full(G_OBJECT(window), "cli", cli, NULL);
-    g_object_ref(cli);
 
-    SpawnVteTerminal(cli, window, widget);
+    gint processes = GetWindowProcesses(options);
+    if (ShardIndex == 0 && processes > 1) {
+        RouteCommandLine(cli, processes);
+        return;
+    }
+
+    GtkWidget *widget = OpenWindow(cli);
+    GtkWidget *window = gtk_widget_get_toplevel(widget);
+
+    if (g_variant_dict_contains(options, "trace-startup")) {
+        g_object_set_data_full(G_OBJECT(window), "started", g_memdup2(&started, sizeof(started)), g_free);
+        g_signal_connect_after(window, "draw", G_CALLBACK(FirstFrameDrawn), NULL);
+    }
+
+    gint benchmark = 0;
+    if (g_variant_dict_lookup(options, "benchmark", "i", &benchmark) && benchmark > 0) {
+        gint panes = 1;
+        gint windows = 1;
+        g_variant_dict_lookup(options, "panes", "i", &panes);
+        g_variant_dict_lookup(options, "windows", "i", &windows);
+        BenchmarkArchive = g_variant_dict_contains(options, "archive");
+        StartBenchmark(cli, widget, benchmark, CLAMP(panes, 1, 64), CLAMP(windows, 1, 64));
+        return;
+    }
+
+    gint latency = 0;
+    if (g_variant_dict_lookup(options, "latency-benchmark", "i", &latency) && latency > 0) {
+        StartLatencyBenchmark(cli, widget, latency, processes);
+        return;
+    }
+
+    gint soak = 0;
+    if (g_variant_dict_lookup(options, "soak", "i", &soak) && soak > 0) {
+        StartSoak(cli, widget, soak);
+        return;
+    }
+
+    const gchar *command = NULL;
+    g_variant_dict_lookup(options, "cmd", "&s", &command);
+    SpawnVteTerminal(cli, window, widget, command, NULL, NULL);
+}
+
+void Startup(GApplication *application, gpointer data) {
+    CompileLinkRegexes();
+    g_main_context_set_poll_func(NULL, WakeupPoll);
+    InstallStyle();
+    InitSettings();
+}
+
+typedef struct {
+    GMainContext* context;
+    gint pending;
+    gboolean running;
+    gboolean active;
+} AccessibilityQuery;
+
+void NameOwnerQueried(GObject* source, GAsyncResult* result, gpointer data) {
+    AccessibilityQuery* query = data;
+    GVariant *reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, NULL);
+    if (reply != NULL) {
+        g_variant_get(reply, "(b)", &query->running);
+        g_variant_unref(reply);
+    }
+    query->pending--;
+    g_main_context_wakeup(query->context);
+}
+
+void AccessibilityStatusQueried(GObject* source, GAsyncResult* result, gpointer data) {
+    AccessibilityQuery* query = data;
+    GVariant *reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, NULL);
+    if (reply != NULL) {
+        GVariant *value = NULL;
+        g_variant_get(reply, "(v)", &value);
+        query->active = g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN) && g_variant_get_boolean(value);
+        g_variant_unref(value);
+        g_variant_unref(reply);
+    }
+    query->pending--;
+    g_main_context_wakeup(query->context);
+}
+
+// The bridge has to be decided before GTK loads it, so both questions go out
+// together and the wait is a single round trip bounded by the query timeout.
+void QueryAccessibility(GApplication *application, gboolean* running, gboolean* active) {
+    AccessibilityQuery query = { g_main_context_new(), 0, FALSE, FALSE };
+    g_main_context_push_thread_default(query.context);
+    GDBusConnection *bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    if (bus != NULL) {
+        query.pending = 2;
+        g_dbus_connection_call(bus, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus", "NameHasOwner",
+                               g_variant_new("(s)", g_application_get_application_id(application)), G_VARIANT_TYPE("(b)"),
+                               G_DBUS_CALL_FLAGS_NONE, ACCESSIBILITY_QUERY_TIMEOUT, NULL, NameOwnerQueried, &query);
+        g_dbus_connection_call(bus, "org.a11y.Bus", "/org/a11y/bus", "org.freedesktop.DBus.Properties", "Get",
+                               g_variant_new("(ss)", "org.a11y.Status", "IsEnabled"), G_VARIANT_TYPE("(v)"),
+                               G_DBUS_CALL_FLAGS_NO_AUTO_START, ACCESSIBILITY_QUERY_TIMEOUT, NULL, AccessibilityStatusQueried, &query);
+        while (query.pending > 0) {
+            g_main_context_iteration(query.context, TRUE);
+        }
+        g_object_unref(bus);
+    }
+    g_main_context_pop_thread_default(query.context);
+    g_main_context_unref(query.context);
+    *running = query.running;
+    *active = query.active;
+}
+
+gint HandleLocalOptions(GApplication *application, GVariantDict *options, gpointer data) {
+    GKeyFile *file = g_key_file_new();
+    gchar *path = GetSettingsPath();
+    gint accessibility = ACCESSIBILITY_AUTO;
+    glong processes = 1;
+    if (g_key_file_load_from_file(file, path, G_KEY_FILE_NONE, NULL)) {
+        accessibility = ReadAccessibility(file);
+        ReadInteger(file, "Advanced", "WindowProcesses", &processes);
+    }
+    g_key_file_free(file);
+    g_free(path);
+
+    if (g_variant_dict_contains(options, "no-accessibility")) {
+        accessibility = ACCESSIBILITY_DISABLED;
+    }
+    gint routed = processes;
+    g_variant_dict_lookup(options, "window-processes", "i", &routed);
+    if (g_getenv("NO_AT_BRIDGE") != NULL) {
+        AccessibilityDecision = "disabled by NO_AT_BRIDGE";
+        return -1;
+    }
+    if (accessibility == ACCESSIBILITY_AUTO && ShardIndex == 0 && routed > 1) {
+        AccessibilityDecision = "kept (routing to window processes)";
+        return -1;
+    }
+    if (accessibility == ACCESSIBILITY_AUTO) {
+        gint64 started = g_get_monotonic_time();
+        gboolean running = FALSE;
+        gboolean active = FALSE;
+        QueryAccessibility(application, &running, &active);
+        AccessibilityQueryTime = g_get_monotonic_time() - started;
+        if (running) {
+            AccessibilityDecision = "kept (forwarding to running instance)";
+            return -1;
+        }
+        if (active) {
+            AccessibilityDecision = "kept (assistive technology active)";
+            return -1;
+        }
+    }
+    AccessibilityDecision = accessibility == ACCESSIBILITY_DISABLED ? "bypassed by setting" : "bypassed (no assistive technology)";
+    g_setenv("NO_AT_BRIDGE", "1", TRUE);
+    AccessibilityBypassed = TRUE;
+    return -1;
 }
 
 void ConnectSignals(GtkApplication *application) {
+    g_signal_connect(application, "handle-local-options", G_CALLBACK(HandleLocalOptions), NULL);
+    g_signal_connect(application, "startup", G_CALLBACK(Startup), NULL);
     g_signal_connect(application, "command-line", G_CALLBACK(CommandLine), NULL);
 }
 
+void AddMainOptions(GtkApplication *application) {
+    g_application_add_main_option(G_APPLICATION(application), "trace-latency", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, "Record keypress-to-display latency and export a histogram on exit", NULL);
+    g_application_add_main_option(G_APPLICATION(application), "no-accessibility", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, "Do not expose terminal text to assistive technologies", NULL);
+    g_application_add_main_option(G_APPLICATION(application), "benchmark", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, "Stream MiB of output through a new window, print the throughput and exit", "MIB");
+    g_application_add_main_option(G_APPLICATION(application), "panes", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, "Split each benchmark window into this many panes", "N");
+    g_application_add_main_option(G_APPLICATION(application), "windows", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, "Open this many benchmark windows", "N");
+    g_application_add_main_option(G_APPLICATION(application), "soak", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, "Churn windows, tabs, menus and dialogs for this many seconds (at least 40) and fail if memory, fds or objects grow; needs GOBJECT_DEBUG=instance-count", "SECONDS");
+    g_application_add_main_option(G_APPLICATION(application), "archive", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, "Archive trimmed benchmark scrollback and report compression, write and seek performance", NULL);
+    g_application_add_main_option(G_APPLICATION(application), "process-benchmark", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, "Time the process monitor's /proc sampler over this many terminals and exit", "N");
+    g_application_add_main_option(G_APPLICATION(application), "latency-benchmark", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, "Measure key-to-draw latency in a quiet window while another window floods, for this many seconds", "SECONDS");
+    g_application_add_main_option(G_APPLICATION(application), "window-processes", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, "Spread new windows across this many processes", "N");
+    g_application_add_main_option(G_APPLICATION(application), "shard", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT, "Window process to run in", "N");
+    g_application_add_main_option(G_APPLICATION(application), "cmd", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING, "Run this command instead of the shell", "COMMAND");
+    g_application_add_main_option(G_APPLICATION(application), "trace-startup", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, "Print the time from startup to the first drawn frame of the window", NULL);
+}
+
 int RunApp(int argc, char **argv) {
-    GtkApplication *application = gtk_application_new("slck.illumiterm", G_APPLICATION_HANDLES_COMMAND_LINE | G_APPLICATION_SEND_ENVIRONMENT); 
+    for (int i = 1; i < argc; i++) {
+        if (g_str_has_prefix(argv[i], "--shard=")) {
+            ShardIndex = CLAMP(atoi(argv[i] + strlen("--shard=")), 0, WINDOW_PROCESSES_MAX);
+        }
+    }
+    gchar *id = ShardIndex > 0 ? g_strdup_printf(APPLICATION_ID ".shard%d", ShardIndex) : g_strdup(APPLICATION_ID);
+    GtkApplication *application = gtk_application_new(id, G_APPLICATION_HANDLES_COMMAND_LINE | G_APPLICATION_SEND_ENVIRONMENT); 
+    g_free(id);
 
     ConnectSignals(application);
+    AddMainOptions(application);
     
     int status = g_application_run(G_APPLICATION(application), argc, argv);
+    SetMetricsExport(FALSE);
+    if (ArchivePool != NULL) {
+        g_thread_pool_free(ArchivePool, FALSE, TRUE);
+    }
     
     g_object_unref(application);
     
@@ -1253,9 +7024,10 @@ int RunApp(int argc, char **argv) {
 }
 
 int main(int argc, char **argv) {
+    ProcessStarted = g_get_monotonic_time();
     int status = RunApp(argc, argv);
 
     return status;
 }
 
-// gcc -O2 -Wall $(pkg-config --cflags vte-2.91) $(pkg-config --cflags gtk+-3.0) illumiterm.c -o illumiterm $(pkg-config --libs vte-2.91) $(pkg-config --libs gtk+-3.0)
+// gcc -O2 -Wall $(pkg-config --cflags vte-2.91) $(pkg-config --cflags gtk+-3.0) $(pkg-config --cflags libpcre2-8) illumiterm.c -o illumiterm $(pkg-config --libs vte-2.91) $(pkg-config --libs gtk+-3.0) $(pkg-config --libs libpcre2-8)